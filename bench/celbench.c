@@ -0,0 +1,139 @@
+// checkcel - check the validity of an Affymetrix CEL file.
+// Copyright (C) 2016 Alastair Droop, The Leeds MRC Medical Bioinformatics Centre <a.p.droop@leeds.ac.uk>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Time readCEL() on each of the given files, with and without reading the intensities:
+//
+//   celbench [-m] [-r repeats] [-t threads] file [...]
+//
+// Each measurement runs in its own process, so that its peak memory use can be reported. Files are read
+// once before timing, so the figures are for files in the page cache.
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "../cel.h"
+
+// Define the struct passed back from each measurement:
+typedef struct {
+  double seconds;
+  char type;
+  char valid;
+} CELbench_result;
+
+static double now_CELbench(){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Check a file once, returning its type (or unknown if it is invalid):
+static char read_CELbench(char *path, char memory_map, int threads, char read_intensity){
+  CELfile f;
+  CELdata d;
+  char type = CEL_TYPE_UNKNOWN;
+  if(memory_map == 1) f = open_CELfile_mapped(path);
+  else f = open_CELfile(path);
+  f.threads = threads;
+  if(f.open == 1){
+    readCEL(f, &d, read_intensity, 0);
+    if(d.valid == 1) type = d.type;
+    free_CELdata(&d);
+  }
+  close_CELfile(f);
+  return type;
+}
+
+// Time repeated checks of a file in a child process, returning its peak resident size in kilobytes:
+static long measure_CELbench(char *path, char memory_map, int threads, char read_intensity, int repeats, CELbench_result *result){
+  int channel[2], status, i;
+  struct rusage usage;
+  pid_t child;
+  double start;
+  if(pipe(channel) != 0) return -1;
+  child = fork();
+  if(child < 0) return -1;
+  if(child == 0){
+    close(channel[0]);
+    result->type = read_CELbench(path, memory_map, threads, read_intensity);
+    start = now_CELbench();
+    for(i=0; i<repeats; i++) read_CELbench(path, memory_map, threads, read_intensity);
+    result->seconds = now_CELbench() - start;
+    result->valid = (result->type != CEL_TYPE_UNKNOWN);
+    if(write(channel[1], result, sizeof(CELbench_result)) != sizeof(CELbench_result)) _exit(1);
+    _exit(0);
+  }
+  close(channel[1]);
+  status = (read(channel[0], result, sizeof(CELbench_result)) == sizeof(CELbench_result));
+  close(channel[0]);
+  if(wait4(child, NULL, 0, &usage) != child) return -1;
+  if(status != 1) return -1;
+  return usage.ru_maxrss;
+}
+
+static const char *type_CELbench(char type){
+  if(type == CEL_TYPE_BINARY) return "binary";
+  if(type == CEL_TYPE_CALVIN) return "calvin";
+  if(type == CEL_TYPE_TEXT) return "text";
+  return "invalid";
+}
+
+int main(int argc, char *argv[]){
+  CELbench_result result;
+  struct stat info;
+  char memory_map = 0, read_intensity;
+  int option, repeats = 5, threads = 1, i;
+  double megabytes;
+  long peak;
+  while((option = getopt(argc, argv, "mr:t:")) != -1){
+    switch(option){
+      case 'm':
+        memory_map = 1;
+        break;
+      case 'r':
+        repeats = atoi(optarg);
+        break;
+      case 't':
+        threads = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "usage: celbench [-m] [-r repeats] [-t threads] file [...]\n");
+        return 1;
+    }
+  }
+  if((repeats < 1) || (threads < 1)){
+    fprintf(stderr, "usage: celbench [-m] [-r repeats] [-t threads] file [...]\n");
+    return 1;
+  }
+  printf("%-28s %-8s %-8s %10s %10s %10s %12s\n", "file", "format", "mode", "size (MB)", "files/s", "MB/s", "peak RSS (MB)");
+  for(i=optind; i<argc; i++){
+    if(stat(argv[i], &info) != 0) continue;
+    megabytes = info.st_size / 1048576.0;
+    for(read_intensity=0; read_intensity<2; read_intensity++){
+      peak = measure_CELbench(argv[i], memory_map, threads, read_intensity, repeats, &result);
+      if(peak < 0){
+        printf("%-28s failed\n", argv[i]);
+        continue;
+      }
+      printf("%-28s %-8s %-8s %10.1f %10.1f %10.1f %12.1f\n", strrchr(argv[i], '/') ? strrchr(argv[i], '/') + 1 : argv[i],
+        type_CELbench(result.type), read_intensity ? "-c" : "header", megabytes,
+        repeats / result.seconds, repeats * megabytes / result.seconds, peak / 1024.0);
+    }
+  }
+  return 0;
+}
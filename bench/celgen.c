@@ -0,0 +1,300 @@
+// checkcel - check the validity of an Affymetrix CEL file.
+// Copyright (C) 2016 Alastair Droop, The Leeds MRC Medical Bioinformatics Centre <a.p.droop@leeds.ac.uk>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Write synthetic binary (version 4), Calvin and text (version 3) CEL files of a given size for benchmarking:
+//
+//   celgen directory rows cols [masked outliers]
+//
+// Dimensions may also be given as a single ROWSxCOLS argument. The files are written as
+// binary_ROWSxCOLS.CEL, calvin_ROWSxCOLS.CEL and text_ROWSxCOLS.CEL in the given directory.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#define CELGEN_HEADER "[0..65534]  synthetic:CLS=%d RWS=%d XIN=1  YIN=1  VE=30        2.0 01/01/16 00:00:00 50000000  M10      HG-U133_Plus_2.1sq                  6"
+#define CELGEN_ALGORITHM "Percentile"
+#define CELGEN_PARAMETERS "Percentile:75;CellMargin:2;OutlierHigh:1.500;OutlierLow:1.004;AlgVersion:6.0"
+#define CELGEN_MARGIN 2
+#define CELGEN_ARRAY "HG-U133_Plus_2"
+
+// A small deterministic random number generator (xorshift64*), so that runs are repeatable. Each format
+// starts again from the same seed, so all three files hold the same intensities:
+#define CELGEN_SEED 0x9e3779b97f4a7c15ULL
+static uint64_t celgen_state = CELGEN_SEED;
+
+static uint64_t celgen_random(){
+  celgen_state ^= celgen_state >> 12;
+  celgen_state ^= celgen_state << 25;
+  celgen_state ^= celgen_state >> 27;
+  return celgen_state * 0x2545f4914f6cdd1dULL;
+}
+
+// Draw an intensity from a roughly log-normal distribution (as real arrays have), to one decimal place:
+static float celgen_intensity(){
+  double u = 0, value;
+  int i;
+  for(i=0; i<4; i++) u += (celgen_random() >> 11) * (1.0 / 9007199254740992.0);
+  value = exp(6.0 + 1.1 * (u - 2.0) * 1.7320508);
+  if(value > 65000) value = 65000;
+  return (float)(floor(value * 10 + 0.5) / 10);
+}
+
+static void put_le32(FILE *f, uint32_t v){
+  unsigned char b[4] = {v & 0xff, (v >> 8) & 0xff, (v >> 16) & 0xff, (v >> 24) & 0xff};
+  fwrite(b, 1, 4, f);
+}
+
+static void put_le16(FILE *f, uint16_t v){
+  unsigned char b[2] = {v & 0xff, (v >> 8) & 0xff};
+  fwrite(b, 1, 2, f);
+}
+
+static void put_lefloat(FILE *f, float v){
+  uint32_t bits;
+  memcpy(&bits, &v, 4);
+  put_le32(f, bits);
+}
+
+static void put_be32(FILE *f, uint32_t v){
+  unsigned char b[4] = {(v >> 24) & 0xff, (v >> 16) & 0xff, (v >> 8) & 0xff, v & 0xff};
+  fwrite(b, 1, 4, f);
+}
+
+static void put_be16(FILE *f, uint16_t v){
+  unsigned char b[2] = {(v >> 8) & 0xff, v & 0xff};
+  fwrite(b, 1, 2, f);
+}
+
+static void put_befloat(FILE *f, float v){
+  uint32_t bits;
+  memcpy(&bits, &v, 4);
+  put_be32(f, bits);
+}
+
+// Binary files hold length-prefixed strings:
+static void put_binary_string(FILE *f, const char *s){
+  put_le32(f, strlen(s));
+  fwrite(s, 1, strlen(s), f);
+}
+
+static int write_binary(const char *path, int rows, int cols, int masked, int outliers){
+  FILE *f;
+  char header[512];
+  int i, cells = rows * cols;
+  celgen_state = CELGEN_SEED;
+  f = fopen(path, "wb");
+  if(f == NULL) return 1;
+  snprintf(header, sizeof(header), CELGEN_HEADER, cols, rows);
+  put_le32(f, 64);
+  put_le32(f, 4);
+  put_le32(f, cols);
+  put_le32(f, rows);
+  put_le32(f, cells);
+  put_binary_string(f, header);
+  put_binary_string(f, CELGEN_ALGORITHM);
+  put_binary_string(f, CELGEN_PARAMETERS);
+  put_le32(f, CELGEN_MARGIN);
+  put_le32(f, outliers);
+  put_le32(f, masked);
+  put_le32(f, 0);
+  for(i=0; i<cells; i++){
+    put_lefloat(f, celgen_intensity());
+    put_lefloat(f, 10.5);
+    put_le16(f, 16);
+  }
+  for(i=0; i<masked + outliers; i++){
+    put_le16(f, i % cols);
+    put_le16(f, i / cols);
+  }
+  return fclose(f);
+}
+
+// Calvin files hold big-endian byte strings and UTF-16 strings:
+static void put_calvin_string(FILE *f, const char *s){
+  put_be32(f, strlen(s));
+  fwrite(s, 1, strlen(s), f);
+}
+
+static void put_calvin_wstring(FILE *f, const char *s){
+  size_t i;
+  put_be32(f, strlen(s));
+  for(i=0; i<strlen(s); i++) put_be16(f, (unsigned char)s[i]);
+}
+
+static long calvin_wstring_size(const char *s){
+  return 4 + 2 * strlen(s);
+}
+
+// Parameters are a name, a typed value and a MIME type:
+static void put_calvin_text_parameter(FILE *f, const char *name, const char *value){
+  put_calvin_wstring(f, name);
+  put_be32(f, 2 * strlen(value));
+  for(size_t i=0; i<strlen(value); i++) put_be16(f, (unsigned char)value[i]);
+  put_calvin_wstring(f, "text/plain");
+}
+
+static void put_calvin_int_parameter(FILE *f, const char *name, int32_t value){
+  put_calvin_wstring(f, name);
+  put_be32(f, 4);
+  put_be32(f, value);
+  put_calvin_wstring(f, "text/x-calvin-integer-32");
+}
+
+// Define a Calvin dataset: its name, columns (name, type and size) and row count:
+typedef struct {
+  const char *name;
+  int column_number;
+  const char *column_names[2];
+  int column_type;
+  int column_size;
+  int rows;
+} celgen_dataset;
+
+// Find the length of a dataset's header (after the two offsets that start it):
+static long calvin_dataset_header_size(celgen_dataset *d){
+  long size = calvin_wstring_size(d->name) + 4 + 4;
+  int i;
+  for(i=0; i<d->column_number; i++) size += calvin_wstring_size(d->column_names[i]) + 1 + 4;
+  return size + 4;
+}
+
+static int write_calvin(const char *path, int rows, int cols, int masked, int outliers){
+  FILE *f;
+  long header_size, group_start, position, data_start, data_end;
+  int i, j, cells = rows * cols;
+  celgen_dataset datasets[5] = {
+    {"Intensity", 1, {"Intensity", NULL}, 7, 4, cells},
+    {"StdDev", 1, {"StdDev", NULL}, 7, 4, cells},
+    {"Pixel", 1, {"Pixel", NULL}, 4, 2, cells},
+    {"Outlier", 2, {"X", "Y"}, 4, 2, outliers},
+    {"Mask", 2, {"X", "Y"}, 4, 2, masked}
+  };
+  celgen_state = CELGEN_SEED;
+  f = fopen(path, "wb");
+  if(f == NULL) return 1;
+  // Work out where the first data group starts, after the file and generic data headers:
+  header_size = 2 + 4 + 4;
+  header_size += 4 + strlen("affymetrix-calvin-intensity") + 4 + strlen("00000000-0000-0000-0000-000000000000");
+  header_size += calvin_wstring_size("2016-01-01T00:00:00Z") + calvin_wstring_size("en-US") + 4;
+  header_size += calvin_wstring_size("affymetrix-array-type") + 4 + 2 * strlen(CELGEN_ARRAY) + calvin_wstring_size("text/plain");
+  header_size += calvin_wstring_size("affymetrix-algorithm-param-CellIntensityCalculationType") + 4 + 2 * strlen(CELGEN_ALGORITHM) + calvin_wstring_size("text/plain");
+  header_size += 3 * (4 + 4 + calvin_wstring_size("text/x-calvin-integer-32"));
+  header_size += calvin_wstring_size("affymetrix-cel-rows") + calvin_wstring_size("affymetrix-cel-cols") + calvin_wstring_size("affymetrix-algorithm-param-CellMargin");
+  header_size += 4;
+  group_start = header_size;
+  // The file header:
+  fputc(59, f);
+  fputc(1, f);
+  put_be32(f, 1);
+  put_be32(f, group_start);
+  // The generic data header:
+  put_calvin_string(f, "affymetrix-calvin-intensity");
+  put_calvin_string(f, "00000000-0000-0000-0000-000000000000");
+  put_calvin_wstring(f, "2016-01-01T00:00:00Z");
+  put_calvin_wstring(f, "en-US");
+  put_be32(f, 5);
+  put_calvin_text_parameter(f, "affymetrix-array-type", CELGEN_ARRAY);
+  put_calvin_text_parameter(f, "affymetrix-algorithm-param-CellIntensityCalculationType", CELGEN_ALGORITHM);
+  put_calvin_int_parameter(f, "affymetrix-cel-rows", rows);
+  put_calvin_int_parameter(f, "affymetrix-cel-cols", cols);
+  put_calvin_int_parameter(f, "affymetrix-algorithm-param-CellMargin", CELGEN_MARGIN);
+  put_be32(f, 0);
+  // The data group header:
+  position = group_start + 4 + 4 + 4 + calvin_wstring_size("Default Group");
+  put_be32(f, 0);
+  put_be32(f, position);
+  put_be32(f, 5);
+  put_calvin_wstring(f, "Default Group");
+  // Each dataset gives the offsets of its data and of the next dataset:
+  for(i=0; i<5; i++){
+    data_start = position + 8 + calvin_dataset_header_size(&datasets[i]);
+    data_end = data_start + (long)datasets[i].rows * datasets[i].column_number * datasets[i].column_size;
+    put_be32(f, data_start);
+    put_be32(f, data_end);
+    put_calvin_wstring(f, datasets[i].name);
+    put_be32(f, 0);
+    put_be32(f, datasets[i].column_number);
+    for(j=0; j<datasets[i].column_number; j++){
+      put_calvin_wstring(f, datasets[i].column_names[j]);
+      fputc(datasets[i].column_type, f);
+      put_be32(f, datasets[i].column_size);
+    }
+    put_be32(f, datasets[i].rows);
+    for(j=0; j<datasets[i].rows; j++){
+      if(i == 0) put_befloat(f, celgen_intensity());
+      else if(i == 1) put_befloat(f, 10.5);
+      else if(i == 2) put_be16(f, 16);
+      else {
+        put_be16(f, j % cols);
+        put_be16(f, j / cols);
+      }
+    }
+    position = data_end;
+  }
+  return fclose(f);
+}
+
+static int write_text(const char *path, int rows, int cols, int masked, int outliers){
+  FILE *f;
+  char header[512];
+  int i, cells = rows * cols;
+  celgen_state = CELGEN_SEED;
+  f = fopen(path, "w");
+  if(f == NULL) return 1;
+  snprintf(header, sizeof(header), CELGEN_HEADER, cols, rows);
+  fprintf(f, "[CEL]\nVersion=3\n\n[HEADER]\nCols=%d\nRows=%d\nTotalX=%d\nTotalY=%d\nOffsetX=0\nGridCornerUL=0 0\n", cols, rows, cols, rows);
+  fprintf(f, "DatHeader=%s\nAlgorithm=%s\nAlgorithmParameters=%s\n\n", header, CELGEN_ALGORITHM, CELGEN_PARAMETERS);
+  fprintf(f, "[INTENSITY]\nNumberCells=%d\nCellHeader=X\tY\tMEAN\tSTDV\tNPIXELS\n", cells);
+  for(i=0; i<cells; i++) fprintf(f, "%3d\t%3d\t%.1f\t%.1f\t%3d\n", i % cols, i / cols, celgen_intensity(), 10.5, 16);
+  fprintf(f, "\n[MASKS]\nNumberCells=%d\nCellHeader=X\tY\n", masked);
+  for(i=0; i<masked; i++) fprintf(f, "%d\t%d\n", i % cols, i / cols);
+  fprintf(f, "\n[OUTLIERS]\nNumberCells=%d\nCellHeader=X\tY\n", outliers);
+  for(i=0; i<outliers; i++) fprintf(f, "%d\t%d\n", i % cols, i / cols);
+  fprintf(f, "\n[MODIFIED]\nNumberCells=0\nCellHeader=X\tY\tORIGMEAN\n\n");
+  return fclose(f);
+}
+
+int main(int argc, char *argv[]){
+  int rows, cols, masked, outliers, argument = 2;
+  char path[4096];
+  if((argc >= 3) && (sscanf(argv[2], "%dx%d", &rows, &cols) == 2)) argument = 3;
+  else if((argc >= 4) && (sscanf(argv[2], "%d", &rows) == 1) && (sscanf(argv[3], "%d", &cols) == 1)) argument = 4;
+  else {
+    fprintf(stderr, "usage: celgen directory rows cols [masked outliers]\n");
+    return 1;
+  }
+  // By default, a small fraction of the cells are masked or outliers, as in real scans:
+  masked = rows * cols / 2000;
+  outliers = rows * cols / 500;
+  if(argc >= argument + 2){
+    masked = atoi(argv[argument]);
+    outliers = atoi(argv[argument + 1]);
+  }
+  if((rows < 1) || (cols < 1) || (masked < 0) || (outliers < 0)){
+    fprintf(stderr, "celgen: invalid dimensions\n");
+    return 1;
+  }
+  snprintf(path, sizeof(path), "%s/binary_%dx%d.CEL", argv[1], rows, cols);
+  if(write_binary(path, rows, cols, masked, outliers) != 0) return 1;
+  snprintf(path, sizeof(path), "%s/calvin_%dx%d.CEL", argv[1], rows, cols);
+  if(write_calvin(path, rows, cols, masked, outliers) != 0) return 1;
+  snprintf(path, sizeof(path), "%s/text_%dx%d.CEL", argv[1], rows, cols);
+  if(write_text(path, rows, cols, masked, outliers) != 0) return 1;
+  return 0;
+}
@@ -22,12 +22,26 @@
 #include <string.h>
 #include <ctype.h>
 #include <math.h>
+#include <pthread.h>
 
+#include "celhash.h"
+#include "celprofile.h"
 #include "celdata.h"
+#include "celstream.h"
 #include "celfile.h"
+#include "celswap.h"
 
 #include "cel_calvin.h"
 #include "cel_binary.h"
 #include "cel_text.h"
 
+#include "celcache.h"
+#include "celcolumns.h"
+#include "celcheck.h"
+#include "celtar.h"
+#include "celuring.h"
+#include "celpool.h"
+#include "celserve.h"
+#include "celwalk.h"
+
 #endif
@@ -37,10 +37,11 @@ char is_CELbinary(CELfile f){
 char readCELbinary(CELfile f, CELdata *d, char read_intensity, char verbose){
   char bitflip = 0;
   char result;
-  int32_t i, magic_number, version, cells, subgrids;
-  size_t n;
-  float *intensities;
+  int32_t i, j, n, magic_number, version, cells, subgrids;
+  float intensities[CEL_INTENSITY_BLOCK_SIZE];
   CELbinary_spotdata *spotdata, *p;
+  CELstats stats;
+  int64_t end;
   char *header = NULL;
   char *parameters = NULL;
   //Sort out the endianness of the machine we're on:
@@ -60,20 +61,16 @@ char readCELbinary(CELfile f, CELdata *d, char read_intensity, char verbose){
   if(readCEL_int32(&cells, 1, f, bitflip) != CEL_READ_VALUE_OK) return 1;
   if(cells != d->rows * d->cols) return 1;
   // Read in the file header:
-  if(readCEL_str(&header, f, bitflip) != CEL_READ_VALUE_OK) return 1;
+  if(readCEL_str_scratch(&header, f, bitflip) != CEL_READ_VALUE_OK) return 1;
   extract_chipname(header, d);
   if(verbose == 1) printf("header: \"%s\"\n", header);
-  free(header); //APD 10/08
-  header = NULL; //APD 10/08
   //Read in the algorithm:
   if(readCEL_str(&d->algorithm, f, bitflip) != CEL_READ_VALUE_OK) return 1;
   for(i=0; i<strlen(d->algorithm); i++) d->algorithm[i] = tolower(d->algorithm[i]);
   if(verbose == 1) printf("algorithm: \"%s\"\n", d->algorithm);
   //Read in the parameters:
-  if(readCEL_str(&parameters, f, bitflip) != CEL_READ_VALUE_OK) return 1;
+  if(readCEL_str_scratch(&parameters, f, bitflip) != CEL_READ_VALUE_OK) return 1;
   if(verbose == 1) printf("parameters: \"%s\"\n", parameters);
-  free(parameters); //APD 10/08
-  parameters = NULL; //APD 10/08
   // Read in the cell margin:
   if(readCEL_int32(&d->cell_margin, 1, f, bitflip) != CEL_READ_VALUE_OK) return 1;
   // Read in the outlier number:
@@ -82,35 +79,35 @@ char readCELbinary(CELfile f, CELdata *d, char read_intensity, char verbose){
   if(readCEL_uint32(&d->masked, 1, f, bitflip) != CEL_READ_VALUE_OK) return 1;
   // Read in the subgrid number:
   if(readCEL_int32(&subgrids, 1, f, bitflip) != CEL_READ_VALUE_OK) return 1;
-  // Read in the intensity data if needed:
+  // In structural mode, check that the declared sections fit in the file without reading them:
+  if(f.structural == 1){
+    if((cells < 0) || (subgrids < 0)) return 1;
+    end = tell_CELfile(f);
+    end += (int64_t)cells * sizeof(CELbinary_spotdata);
+    end += ((int64_t)d->outliers + d->masked) * CEL_BINARY_CELL_ENTRY_SIZE;
+    end += (int64_t)subgrids * CEL_BINARY_SUBGRID_SIZE;
+    if(check_CELfile_extent(f, end) != CEL_READ_VALUE_OK) return 1;
+  }
+  // Read in the intensity data if needed, a block of spots at a time:
   if(read_intensity ==1){
-    intensities = (float*)malloc(cells * sizeof(float));
-    if(intensities == NULL) return 1;
-    spotdata = (CELbinary_spotdata*)malloc(cells * sizeof(CELbinary_spotdata));
-    if(spotdata == NULL){
-      free(intensities);
-      intensities = NULL;
-      return 1;
-    }
-    n = fread(spotdata, sizeof(CELbinary_spotdata), cells, f.handle);
-    if(n != cells){
-      free(intensities);
-      intensities = NULL;
-      free(spotdata);
-      spotdata = NULL;
-      return 1;
-    }
-    p = spotdata;
-    for(i=0; i<cells; i++){
-      intensities[i] = p->intensity;
-      p++;
+    enter_CELprofile(CEL_PROFILE_PAYLOAD);
+    spotdata = (CELbinary_spotdata*)scratch_CELfile(CEL_INTENSITY_BLOCK_SIZE * sizeof(CELbinary_spotdata), f);
+    if(spotdata == NULL) return 1;
+    init_CELstats(&stats, f.fingerprint);
+    visit_CELstats(&stats, f.visit, f.visit_arg);
+    for(i=0; i<cells; i+=n){
+      n = cells - i;
+      if(n > CEL_INTENSITY_BLOCK_SIZE) n = CEL_INTENSITY_BLOCK_SIZE;
+      if(readCEL_bytes(spotdata, n * sizeof(CELbinary_spotdata), f) != CEL_READ_VALUE_OK) return 1;
+      p = spotdata;
+      for(j=0; j<n; j++){
+        memcpy(&intensities[j], &p->intensity, sizeof(float));
+        p++;
+      }
+      if(needs_CEL_byteswap(bitflip) == 1) swap_CEL_32(intensities, intensities, n);
+      feed_CELstats(&stats, intensities, n);
     }
-    free(spotdata);
-    spotdata = NULL;
-    calculate_intensity_stats(intensities, cells, &d->intensity_max, &d->intensity_min, &d->intensity_n_unique, &d->intensity_n_invalid);
-    d->intensity_stats_calculated = 1;
-    free(intensities);
-    intensities = NULL;    
+    finish_CELstats(&stats, d);
   }
   // Mark the CEL data as valid:
   d->type = CEL_TYPE_BINARY;
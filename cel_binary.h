@@ -26,6 +26,10 @@ typedef struct {
 } CELbinary_spotdata;
 #pragma pack()
 
+// Define the sizes of the masked/outlier cell entries and the subgrid records that follow the spots:
+#define CEL_BINARY_CELL_ENTRY_SIZE 4
+#define CEL_BINARY_SUBGRID_SIZE 56
+
 char is_CELbinary(CELfile f);
 char readCELbinary(CELfile f, CELdata *d, char read_intensity, char verbose);
 
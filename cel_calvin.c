@@ -20,6 +20,7 @@
 char readCELcalvin_parameter(CELcalvin_parameter *p, CELfile f, char bitflip){
   char result;
   char* type = NULL;
+  p->value = NULL;
   result = readCEL_wstr(&(p->name), f, bitflip);
   if(result != CEL_READ_VALUE_OK){
     free(p->name);
@@ -42,14 +43,12 @@ char readCELcalvin_parameter(CELcalvin_parameter *p, CELfile f, char bitflip){
     p->value = NULL;
     return CEL_READ_VALUE_FAILED;    
   }
-  result = readCEL_wstr(&type, f, bitflip);
+  result = readCEL_wstr_scratch(&type, f, bitflip);
   if(result != CEL_READ_VALUE_OK){
     free(p->value);
     free(p->name);
     p->name = NULL;
     p->value = NULL;
-    free(type);
-    type = NULL;
     return CEL_READ_VALUE_FAILED;    
   }
   p->type = CEL_CALVIN_MIMETYPE_UNKNOWN;
@@ -62,8 +61,6 @@ char readCELcalvin_parameter(CELcalvin_parameter *p, CELfile f, char bitflip){
   else if(strcmp(type, "text/x-calvin-float") == 0) p->type = CEL_CALVIN_MIMETYPE_FLOAT;
   else if(strcmp(type, "text/plain") == 0) p->type = CEL_CALVIN_MIMETYPE_PLAINTEXT;
   else if(strcmp(type, "text/ascii") == 0) p->type = CEL_CALVIN_MIMETYPE_ASCII;
-  free(type);
-  type = NULL;
   return CEL_READ_VALUE_OK;
 }
 
@@ -176,81 +173,97 @@ void free_CELcalvin_datagroup(CELcalvin_datagroup *g){
   }
 }
 
-char readCELcalvin_dataset_column(CELcalvin_dataset_column *c, CELfile f, char bitflip){
-  if(readCEL_wstr(&c->name, f, bitflip) != CEL_READ_VALUE_OK){
-    free(c->name);
-    c->name = NULL;
-    return CEL_READ_VALUE_FAILED;
-  }
-  if(readCEL_int8(&c->type, 1, f) != CEL_READ_VALUE_OK) return CEL_READ_VALUE_FAILED;
-  if(readCEL_int32(&c->size, 1, f, bitflip) != CEL_READ_VALUE_OK) return CEL_READ_VALUE_FAILED;
-  return CEL_READ_VALUE_OK;
+// Skip a (wide, if wide is 1) string, or a parameter value, without reading it:
+static char skip_CELcalvin_string(CELfile f, char bitflip, char wide){
+  int32_t length;
+  if(readCEL_int32(&length, 1, f, bitflip) != CEL_READ_VALUE_OK) return CEL_READ_VALUE_FAILED;
+  if(length < 0) return CEL_READ_VALUE_FAILED;
+  if(wide == 1) return skip_CELfile(f, (int64_t)length * 2);
+  return skip_CELfile(f, length);
 }
 
-void free_CELcalvin_dataset_column(CELcalvin_dataset_column *c){
-  c->type = 0;
-  c->size = 0;
-  if(c->name != NULL){
-    free(c->name);
-    c->name = NULL;
-  }
-}
-
-char readCELcalvin_dataset(CELcalvin_dataset *g, CELfile f, char bitflip){
+// Read the header of the dataset at the cursor into an index entry, skipping its parameters and column names:
+static char index_CELcalvin_dataset(CELcalvin_dataset_entry *e, CELfile f, char bitflip){
+  char *name;
+  int8_t type;
+  int32_t size;
   int i;
-  if(readCEL_uint32(&g->first_element_pos, 1, f, bitflip) == CEL_READ_VALUE_FAILED) return CEL_READ_VALUE_FAILED;
-  if(readCEL_uint32(&g->next_dataset_pos, 1, f, bitflip) == CEL_READ_VALUE_FAILED) return CEL_READ_VALUE_FAILED;
-  if(readCEL_wstr(&g->name, f, bitflip) == CEL_READ_VALUE_FAILED){
-    free(g->name);
-    g->name = NULL;
-    return CEL_READ_VALUE_FAILED;
-  }
-  if(readCEL_int32(&g->parameter_number, 1, f, bitflip) == CEL_READ_VALUE_FAILED) return CEL_READ_VALUE_FAILED;
-  g->parameters = (CELcalvin_parameter*)malloc(g->parameter_number * sizeof(CELcalvin_parameter));
-  if(g->parameters == NULL){
-    free(g->name);
-    g->name = NULL;
-    return CEL_READ_VALUE_FAILED;    
-  }
-  for(i=0; i<g->parameter_number; i++) readCELcalvin_parameter(&(g->parameters[i]), f, bitflip);
-  if(readCEL_uint32(&(g->column_number), 1, f, bitflip) == CEL_READ_VALUE_FAILED){
-    for(i=0; i<g->parameter_number; i++) freeCELcalvin_parameter(&(g->parameters[i]));
-    free(g->parameters);
-    g->parameters = NULL;
-    free(g->name);
-    g->name = NULL;
-    return CEL_READ_VALUE_FAILED;
+  if(readCEL_uint32(&e->first_element_pos, 1, f, bitflip) != CEL_READ_VALUE_OK) return CEL_READ_VALUE_FAILED;
+  if(readCEL_uint32(&e->next_dataset_pos, 1, f, bitflip) != CEL_READ_VALUE_OK) return CEL_READ_VALUE_FAILED;
+  // Longer names are cut short, which is harmless as none of the datasets looked for by name are that long:
+  if(readCEL_wstr_scratch(&name, f, bitflip) != CEL_READ_VALUE_OK) return CEL_READ_VALUE_FAILED;
+  strncpy(e->name, name, CEL_CALVIN_INDEX_NAME_SIZE - 1);
+  e->name[CEL_CALVIN_INDEX_NAME_SIZE - 1] = '\0';
+  if((readCEL_int32(&e->parameter_number, 1, f, bitflip) != CEL_READ_VALUE_OK) || (e->parameter_number < 0)) return CEL_READ_VALUE_FAILED;
+  for(i=0; i<e->parameter_number; i++){
+    if(skip_CELcalvin_string(f, bitflip, 1) != CEL_READ_VALUE_OK) return CEL_READ_VALUE_FAILED;
+    if(skip_CELcalvin_string(f, bitflip, 0) != CEL_READ_VALUE_OK) return CEL_READ_VALUE_FAILED;
+    if(skip_CELcalvin_string(f, bitflip, 1) != CEL_READ_VALUE_OK) return CEL_READ_VALUE_FAILED;
   }
-  g->columns = (CELcalvin_dataset_column*)malloc(g->column_number * sizeof(CELcalvin_dataset_column));
-  if(g->columns == NULL){
-    for(i=0; i<g->parameter_number; i++) freeCELcalvin_parameter(&(g->parameters[i]));
-    free(g->parameters);
-    g->parameters = NULL;
-    free(g->name);
-    g->name = NULL;
-    return CEL_READ_VALUE_FAILED;
+  if(readCEL_uint32(&e->column_number, 1, f, bitflip) != CEL_READ_VALUE_OK) return CEL_READ_VALUE_FAILED;
+  e->row_size = 0;
+  for(i=0; i<e->column_number; i++){
+    if(skip_CELcalvin_string(f, bitflip, 1) != CEL_READ_VALUE_OK) return CEL_READ_VALUE_FAILED;
+    if((readCEL_int8(&type, 1, f) != CEL_READ_VALUE_OK) || (readCEL_int32(&size, 1, f, bitflip) != CEL_READ_VALUE_OK)) return CEL_READ_VALUE_FAILED;
+    if(i < CEL_CALVIN_INDEX_COLUMNS){
+      e->column_types[i] = type;
+      e->column_sizes[i] = size;
+    }
+    // Negative sizes are kept out of the row size, but still fail the structural check:
+    if(size < 0) e->row_size = -1;
+    else if(e->row_size >= 0) e->row_size += size;
   }
-  for(i=0; i<g->column_number; i++) readCELcalvin_dataset_column(&(g->columns[i]), f, bitflip);
-  if(readCEL_uint32(&(g->row_number), 1, f, bitflip) == CEL_READ_VALUE_FAILED) return CEL_READ_VALUE_FAILED;
+  if(readCEL_uint32(&e->row_number, 1, f, bitflip) != CEL_READ_VALUE_OK) return CEL_READ_VALUE_FAILED;
+  e->header_end = tell_CELfile(f);
   return CEL_READ_VALUE_OK;
 }
 
-void free_CELcalvin_dataset(CELcalvin_dataset *g){
-  int i;
-  if(g->name != NULL){
-    free(g->name);
-    g->name = NULL;
-  }
-  if(g->parameters != NULL){
-    for(i=0; i<g->parameter_number; i++) freeCELcalvin_parameter(&(g->parameters[i]));
-    free(g->parameters);
-    g->parameters = NULL;
+char index_CELcalvin_datagroup(CELcalvin_index *x, CELcalvin_datagroup *g, CELfile f, char bitflip){
+  CELcalvin_dataset_entry *entries;
+  int32_t size;
+  int32_t i;
+  x->entries = NULL;
+  x->n = 0;
+  x->size = 0;
+  if(seek_CELfile(f, g->first_dataset_pos) != CEL_READ_VALUE_OK) return CEL_READ_VALUE_FAILED;
+  for(i=0; i<g->dataset_number; i++){
+    // The declared count is not trusted for the allocation, so the index grows as datasets are found:
+    if(x->n == x->size){
+      size = x->size * 2;
+      if(size < 8) size = 8;
+      entries = (CELcalvin_dataset_entry*)realloc(x->entries, size * sizeof(CELcalvin_dataset_entry));
+      if(entries == NULL) return CEL_READ_VALUE_FAILED;
+      x->entries = entries;
+      x->size = size;
+    }
+    if(index_CELcalvin_dataset(&x->entries[x->n], f, bitflip) != CEL_READ_VALUE_OK) return CEL_READ_VALUE_FAILED;
+    if(seek_CELfile(f, x->entries[x->n].next_dataset_pos) != CEL_READ_VALUE_OK) return CEL_READ_VALUE_FAILED;
+    x->n++;
   }
-  if(g->columns != NULL){
-    for(i=0; i<g->column_number; i++) free_CELcalvin_dataset_column(&(g->columns[i]));
-    free(g->columns);
-    g->columns = NULL;
+  return CEL_READ_VALUE_OK;
+}
+
+CELcalvin_dataset_entry *find_CELcalvin_dataset(CELcalvin_index *x, const char *name){
+  int32_t i;
+  for(i=x->n - 1; i>=0; i--){
+    if(strcmp(x->entries[i].name, name) == 0) return &x->entries[i];
   }
+  return NULL;
+}
+
+char check_CELcalvin_dataset_entry(CELcalvin_dataset_entry *e, CELfile f){
+  // The rows must start after the header, and fit between it and the next dataset:
+  if(e->row_size < 0) return CEL_READ_VALUE_FAILED;
+  if(e->first_element_pos < e->header_end) return CEL_READ_VALUE_FAILED;
+  if(e->first_element_pos + (e->row_size * e->row_number) > e->next_dataset_pos) return CEL_READ_VALUE_FAILED;
+  return check_CELfile_extent(f, e->next_dataset_pos);
+}
+
+void free_CELcalvin_index(CELcalvin_index *x){
+  if(x->entries != NULL) free(x->entries);
+  x->entries = NULL;
+  x->n = 0;
+  x->size = 0;
 }
 
 char is_CELcalvin(CELfile f){
@@ -285,21 +298,11 @@ char is_CELcalvin(CELfile f){
     return 0;
   }
   // Check the data type identifier:
-  result = readCEL_str(&data_type, f, bitflip);
-  if(result != CEL_READ_VALUE_OK){
-    free(data_type);
-    data_type = NULL;
+  result = readCEL_str_scratch(&data_type, f, bitflip);
+  if((result != CEL_READ_VALUE_OK) || (strcmp(data_type, "affymetrix-calvin-intensity") != 0)){
     reset_CELfile(f);
     return 0;
   }
-  if(strcmp(data_type, "affymetrix-calvin-intensity") != 0){
-    free(data_type);
-    data_type = NULL;
-    reset_CELfile(f);
-    return 0;
-  }
-  free(data_type);
-  data_type = NULL;
   // All initial checks look good, to reset the file and return success:
   reset_CELfile(f);
   return 1;
@@ -313,7 +316,9 @@ char readCELcalvin(CELfile f, CELdata *d, char read_intensity, char verbose){
   char *file_id = NULL;
   char *date = NULL;
   char *locale = NULL;
-  float *intensities;
+  float intensities[CEL_INTENSITY_BLOCK_SIZE];
+  CELstats stats;
+  size_t n;
   u_int8_t magic_number, version;
   int32_t group_number, parameter_number;
   u_int32_t first_group_offset;
@@ -333,41 +338,23 @@ char readCELcalvin(CELfile f, CELdata *d, char read_intensity, char verbose){
   // Read in the offset of the first group:
   if(readCEL_uint32(&first_group_offset, 1, f, bitflip) != CEL_READ_VALUE_OK) return 1;
   // Check the data type identifier:
-  result = readCEL_str(&data_type, f, bitflip);
-  if(result != CEL_READ_VALUE_OK){
-    free(data_type);
-    data_type = NULL;
-    return 1;
-  }
-  if(strcmp(data_type, "affymetrix-calvin-intensity") != 0){
-    free(data_type);
-    data_type = NULL;
-    return 1;
-  }
-  free(data_type);
-  data_type = NULL;
+  result = readCEL_str_scratch(&data_type, f, bitflip);
+  if((result != CEL_READ_VALUE_OK) || (strcmp(data_type, "affymetrix-calvin-intensity") != 0)) return 1;
   // Read in the unique file ID:
-  if(readCEL_str(&file_id, f, bitflip) != CEL_READ_VALUE_OK) return 1;
+  if(readCEL_str_scratch(&file_id, f, bitflip) != CEL_READ_VALUE_OK) return 1;
   if(verbose == 1) printf("file ID: %s\n", file_id);
-  free(file_id);
-  file_id = NULL;
   // Read in the date:
-  result = readCEL_wstr(&date, f, bitflip);
-  free(date);
-  date = NULL;
-  if(result != CEL_READ_VALUE_OK) return 1;
+  if(readCEL_wstr_scratch(&date, f, bitflip) != CEL_READ_VALUE_OK) return 1;
   // Read in the locale:
-  result = readCEL_wstr(&locale, f, 1);
-  if(verbose == 1) printf("locale: \"%s\"\n", locale);
-  free(locale);
-  locale = NULL;
+  result = readCEL_wstr_scratch(&locale, f, 1);
   if(result != CEL_READ_VALUE_OK) return 1;
+  if(verbose == 1) printf("locale: \"%s\"\n", locale);
   // Read in the number of parameters:
   if(readCEL_int32(&parameter_number, 1, f, bitflip) != CEL_READ_VALUE_OK) return 1;
   if(verbose == 1) printf("parameter count: %d\n", parameter_number);
   // Read in each parameter in turn, and extract the data we need:
   for(i=0; i<parameter_number; i++){
-    readCELcalvin_parameter(&parameter, f, bitflip);
+    if(readCELcalvin_parameter(&parameter, f, bitflip) != CEL_READ_VALUE_OK) return 1;
     if(verbose == 1) printCELcalvin_parameter(&parameter);
     if(strcmp(parameter.name, "affymetrix-array-type") == 0) decode_CELcalvin_parameter_plaintext(&parameter, &(d->array));
     else if(strcmp(parameter.name, "affymetrix-algorithm-param-CellIntensityCalculationType") == 0){
@@ -380,43 +367,56 @@ char readCELcalvin(CELfile f, CELdata *d, char read_intensity, char verbose){
     freeCELcalvin_parameter(&parameter);
   }
   //  Read in the single data group:
-  fseek(f.handle, first_group_offset, SEEK_SET);
+  if(seek_CELfile(f, first_group_offset) != CEL_READ_VALUE_OK) return 1;
   CELcalvin_datagroup data_group;
-  readCELcalvin_datagroup(&data_group, f, bitflip);
+  if(readCELcalvin_datagroup(&data_group, f, bitflip) != CEL_READ_VALUE_OK) return 1;
   if(verbose == 1) printf("first data group \"%s\" contains %d datasets:\n", data_group.name, data_group.dataset_number);
-  // Go to the start of the first data set:
-  fseek(f.handle, data_group.first_dataset_pos, SEEK_SET);
-  CELcalvin_dataset data_set;
-  for(i=0; i<data_group.dataset_number; i++){
-    readCELcalvin_dataset(&data_set, f, bitflip);
-    if(verbose == 1) printf(" dataset [%d] \"%s\" contains %d parameter(s), %d column(s) and %d row(s)\n", i, data_set.name, data_set.parameter_number, data_set.column_number, data_set.row_number);
-    if(strcmp(data_set.name, "Outlier") == 0) d->outliers = data_set.row_number;
-    if(strcmp(data_set.name, "Mask") == 0) d->masked = data_set.row_number;
-    if((strcmp(data_set.name, "Intensity") == 0) && (read_intensity == 1)){
-      fseek(f.handle, data_set.first_element_pos, SEEK_SET);
-      intensities = (float*)malloc(data_set.row_number * sizeof(float));
-      if(intensities == NULL){
-        free_CELcalvin_dataset(&data_set);
-        free_CELcalvin_datagroup(&data_group);
-        return 1;
-      }
-      result = readCEL_float(intensities, data_set.row_number, f, bitflip);
-      if(result != CEL_READ_VALUE_OK){
-        free(intensities);
-        intensities = NULL;
-        free_CELcalvin_dataset(&data_set);
-        free_CELcalvin_datagroup(&data_group);
+  // Index the datasets without decoding their parameters:
+  CELcalvin_index index;
+  CELcalvin_dataset_entry *entry;
+  result = index_CELcalvin_datagroup(&index, &data_group, f, bitflip);
+  free_CELcalvin_datagroup(&data_group);
+  if(result != CEL_READ_VALUE_OK){
+    free_CELcalvin_index(&index);
+    return 1;
+  }
+  for(i=0; i<index.n; i++){
+    entry = &index.entries[i];
+    // In structural mode, the declared payload must fit without any of it being read:
+    if((f.structural == 1) && (check_CELcalvin_dataset_entry(entry, f) != CEL_READ_VALUE_OK)){
+      free_CELcalvin_index(&index);
+      return 1;
+    }
+    if(verbose == 1) printf(" dataset [%d] \"%s\" contains %d parameter(s), %d column(s) and %d row(s)\n", i, entry->name, entry->parameter_number, entry->column_number, entry->row_number);
+  }
+  entry = find_CELcalvin_dataset(&index, "Outlier");
+  if(entry != NULL) d->outliers = entry->row_number;
+  entry = find_CELcalvin_dataset(&index, "Mask");
+  if(entry != NULL) d->masked = entry->row_number;
+  // Jump straight to the intensities:
+  entry = find_CELcalvin_dataset(&index, "Intensity");
+  if((entry != NULL) && (read_intensity == 1)){
+    if(seek_CELfile(f, entry->first_element_pos) != CEL_READ_VALUE_OK){
+      free_CELcalvin_index(&index);
+      return 1;
+    }
+    // Read the intensities a block at a time:
+    enter_CELprofile(CEL_PROFILE_PAYLOAD);
+    init_CELstats(&stats, f.fingerprint);
+    visit_CELstats(&stats, f.visit, f.visit_arg);
+    for(j=0; j<entry->row_number; j+=n){
+      n = entry->row_number - j;
+      if(n > CEL_INTENSITY_BLOCK_SIZE) n = CEL_INTENSITY_BLOCK_SIZE;
+      if(readCEL_float(intensities, n, f, bitflip) != CEL_READ_VALUE_OK){
+        free_CELcalvin_index(&index);
         return 1;
       }
-      calculate_intensity_stats(intensities, data_set.row_number, &d->intensity_max, &d->intensity_min, &d->intensity_n_unique, &d->intensity_n_invalid);
-      d->intensity_stats_calculated = 1;
-      free(intensities);
-      intensities = NULL;
+      feed_CELstats(&stats, intensities, n);
     }
-    fseek(f.handle, data_set.next_dataset_pos, SEEK_SET);
-    free_CELcalvin_dataset(&data_set);
+    finish_CELstats(&stats, d);
+    enter_CELprofile(CEL_PROFILE_HEADER);
   }
-  free_CELcalvin_datagroup(&data_group);
+  free_CELcalvin_index(&index);
   // No issues, so this must be valid:
   d->type = CEL_TYPE_CALVIN;
   d->valid = 1;
@@ -52,30 +52,36 @@ typedef struct {
 void free_CELcalvin_datagroup(CELcalvin_datagroup *g);
 char readCELcalvin_datagroup(CELcalvin_datagroup *g, CELfile f, char bitflip);
 
-// Structure to hold a Calvin dataset column:
-typedef struct {
-  char* name;
-  int8_t type;
-  int32_t size;
-} CELcalvin_dataset_column;
-
-char readCELcalvin_dataset_column(CELcalvin_dataset_column *c, CELfile f, char bitflip);
-void free_CELcalvin_dataset_column(CELcalvin_dataset_column *c);
-
-// Structure to hold Calvin dataset objects:  
+// Structure to hold the index entry of a Calvin dataset: where its header and rows are, and how its rows are laid
+// out (columns past CEL_CALVIN_INDEX_COLUMNS are only counted in the row size), without its parameter values:
+#define CEL_CALVIN_INDEX_NAME_SIZE 32
+#define CEL_CALVIN_INDEX_COLUMNS 8
 typedef struct {
+  char name[CEL_CALVIN_INDEX_NAME_SIZE];
+  long header_end;
   u_int32_t first_element_pos;
   u_int32_t next_dataset_pos;
-  char* name;
   int32_t parameter_number;
-  CELcalvin_parameter *parameters;
   u_int32_t column_number;
-  CELcalvin_dataset_column *columns;
+  int8_t column_types[CEL_CALVIN_INDEX_COLUMNS];
+  int32_t column_sizes[CEL_CALVIN_INDEX_COLUMNS];
+  int64_t row_size;
   u_int32_t row_number;
-} CELcalvin_dataset;
+} CELcalvin_dataset_entry;
+
+// Structure to hold the index of the datasets in a data group:
+typedef struct {
+  CELcalvin_dataset_entry *entries;
+  int32_t n;
+  int32_t size;
+} CELcalvin_index;
 
-char readCELcalvin_dataset(CELcalvin_dataset *g, CELfile f, char bitflip);
-void free_CELcalvin_dataset(CELcalvin_dataset *g);
+// Functions to index the datasets in a data group by skipping through their headers, and to find one by name
+// (the last if several share it):
+char index_CELcalvin_datagroup(CELcalvin_index *x, CELcalvin_datagroup *g, CELfile f, char bitflip);
+CELcalvin_dataset_entry *find_CELcalvin_dataset(CELcalvin_index *x, const char *name);
+char check_CELcalvin_dataset_entry(CELcalvin_dataset_entry *e, CELfile f);
+void free_CELcalvin_index(CELcalvin_index *x);
 
 
 // Functions to decode the data stored in a calvin parameter object:
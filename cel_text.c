@@ -17,15 +17,376 @@
 #include <stdio.h>
 #include "cel.h"
 
-void readCELtext_line(CELfile f, CELtext_current_state *state){
-  char *result;
+// Powers of ten that are exactly representable as doubles:
+static const double CELtext_powers_of_ten[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18};
+
+char open_CELtext_reader(CELtext_reader *r, CELfile f){
+  long offset = tell_CELfile(f);
+  if(offset < 0) return CEL_READ_VALUE_FAILED;
+  if(f.backend == CEL_BACKEND_MMAP) return open_CELtext_range_reader(r, f, offset, NULL, 0);
+  r->file = f;
+  r->start = 0;
+  r->end = 0;
+  r->offset = offset;
+  r->eof = 0;
+  r->positional = 0;
+  r->size = CEL_TEXT_BUFFER_SIZE;
+  r->data = (char*)scratch_CELfile(r->size, f);
+  if(r->data == NULL) return CEL_READ_VALUE_FAILED;
+  return CEL_READ_VALUE_OK;
+}
+
+char open_CELtext_range_reader(CELtext_reader *r, CELfile f, long offset, char *buffer, size_t size){
+  r->file = f;
+  r->start = 0;
+  r->end = 0;
+  r->offset = offset;
+  r->eof = 0;
+  r->positional = 1;
+  // Mapped files are read in place:
+  if(f.backend == CEL_BACKEND_MMAP){
+    if(offset > f.map->size) return CEL_READ_VALUE_FAILED;
+    r->data = (char*)f.map->data;
+    r->size = f.map->size;
+    r->start = offset;
+    r->end = r->size;
+    r->offset = 0;
+    r->eof = 1;
+    return CEL_READ_VALUE_OK;
+  }
+  r->data = buffer;
+  r->size = size;
+  if(r->data == NULL) return CEL_READ_VALUE_FAILED;
+  return CEL_READ_VALUE_OK;
+}
+
+long tell_CELtext_reader(CELtext_reader *r){
+  return r->offset + r->start;
+}
+
+char seek_CELtext_reader(CELtext_reader *r, long offset){
+  // Seeks within the buffered data need no I/O:
+  if((offset >= r->offset) && (offset <= r->offset + (long)r->end)){
+    r->start = offset - r->offset;
+    return CEL_READ_VALUE_OK;
+  }
+  if((r->file.backend == CEL_BACKEND_MMAP) || (offset < 0)) return CEL_READ_VALUE_FAILED;
+  if((r->positional == 0) && (seek_CELfile(r->file, offset) != CEL_READ_VALUE_OK)) return CEL_READ_VALUE_FAILED;
+  r->start = 0;
+  r->end = 0;
+  r->offset = offset;
+  r->eof = 0;
+  return CEL_READ_VALUE_OK;
+}
+
+// Move any unread data to the start of the buffer and top it up from the file:
+static char fill_CELtext_reader(CELtext_reader *r){
+  size_t n;
+  if(r->eof == 1) return CEL_READ_VALUE_FAILED;
+  if(r->start > 0){
+    memmove(r->data, r->data + r->start, r->end - r->start);
+    r->offset += r->start;
+    r->end -= r->start;
+    r->start = 0;
+  }
+  if(r->end == r->size) return CEL_READ_VALUE_FAILED;
+  if(r->positional == 1) n = readCEL_at(r->data + r->end, r->size - r->end, r->offset + r->end, r->file);
+  else n = readCEL_block(r->data + r->end, r->size - r->end, r->file);
+  // Sequential blocks can come up short before the end of the file, so only an empty read is final:
+  if((n == 0) || ((r->positional == 1) && (n < r->size - r->end))) r->eof = 1;
+  r->end += n;
+  if(n == 0) return CEL_READ_VALUE_FAILED;
+  return CEL_READ_VALUE_OK;
+}
+
+char *next_CELtext_line(CELtext_reader *r, size_t *length){
+  char *line, *newline;
+  size_t searched = 0;
+  while(1){
+    newline = NULL;
+    if(r->end > r->start + searched) newline = memchr(r->data + r->start + searched, '\n', r->end - r->start - searched);
+    if(newline != NULL) break;
+    searched = r->end - r->start;
+    if(fill_CELtext_reader(r) != CEL_READ_VALUE_OK){
+      // The final line may have no newline, and overlong lines are split, as fgets() would:
+      if(r->end == r->start) return NULL;
+      line = r->data + r->start;
+      *length = r->end - r->start;
+      r->start = r->end;
+      return line;
+    }
+  }
+  line = r->data + r->start;
+  *length = newline - line + 1;
+  r->start += *length;
+  return line;
+}
+
+char skip_CELtext_lines(CELtext_reader *r, size_t n){
+  char *p, *end, *newline;
+  while(n > 0){
+    p = r->data + r->start;
+    end = r->data + r->end;
+    // Step from newline to newline through the buffered data:
+    while((n > 0) && (p < end) && ((newline = memchr(p, '\n', end - p)) != NULL)){
+      p = newline + 1;
+      n--;
+    }
+    r->start = p - r->data;
+    if(n == 0) return CEL_READ_VALUE_OK;
+    if(fill_CELtext_reader(r) != CEL_READ_VALUE_OK) break;
+  }
+  if(n == 0) return CEL_READ_VALUE_OK;
+  // An unterminated final line still counts as a line:
+  if((n == 1) && (r->end > r->start)){
+    r->start = r->end;
+    return CEL_READ_VALUE_OK;
+  }
+  return CEL_READ_VALUE_FAILED;
+}
+
+// Parse a decimal number that is not handled by the fast path in parse_CELtext_float():
+static const char *parse_CELtext_float_slow(const char *p, const char *end, float *value){
+  char token[CEL_TEXT_NUMBER_MAX + 1];
+  char *token_end;
+  size_t length = 0;
+  while((p + length < end) && (length < CEL_TEXT_NUMBER_MAX) && (!isspace((unsigned char)p[length]))) length++;
+  memcpy(token, p, length);
+  token[length] = '\0';
+  *value = strtof(token, &token_end);
+  if(token_end == token) return NULL;
+  return p + (token_end - token);
+}
+
+// Parse a decimal number such as "18779.0", returning a pointer past it (or NULL if there is none):
+static const char *parse_CELtext_float(const char *p, const char *end, float *value){
+  const char *start = p;
+  u_int64_t mantissa = 0;
+  int digits = 0, fraction_digits = 0;
+  char negative = 0;
+  if((p < end) && ((*p == '-') || (*p == '+'))){
+    negative = (*p == '-');
+    p++;
+  }
+  while((p < end) && (*p >= '0') && (*p <= '9')){
+    mantissa = (mantissa * 10) + (*p - '0');
+    digits++;
+    p++;
+  }
+  if((p < end) && (*p == '.')){
+    p++;
+    while((p < end) && (*p >= '0') && (*p <= '9')){
+      mantissa = (mantissa * 10) + (*p - '0');
+      digits++;
+      fraction_digits++;
+      p++;
+    }
+  }
+  // Exponents, very long numbers and special values are left to the C library:
+  if((digits == 0) || (digits > 18) || ((p < end) && (isalpha((unsigned char)*p)))) return parse_CELtext_float_slow(start, end, value);
+  *value = (float)((double)mantissa / CELtext_powers_of_ten[fraction_digits]);
+  if(negative == 1) *value = -*value;
+  return p;
+}
+
+// Skip the whitespace and an integer field of an intensity row:
+static const char *skip_CELtext_integer(const char *p, const char *end){
+  const char *digits;
+  while((p < end) && ((*p == ' ') || (*p == '\t'))) p++;
+  if((p < end) && ((*p == '-') || (*p == '+'))) p++;
+  digits = p;
+  while((p < end) && (*p >= '0') && (*p <= '9')) p++;
+  if(p == digits) return NULL;
+  return p;
+}
+
+char parse_CELtext_row(const char *line, size_t length, float *intensity){
+  const char *p = line, *end = line + length;
+  // Skip the X and Y coordinates:
+  p = skip_CELtext_integer(p, end);
+  if(p == NULL) return CEL_READ_VALUE_FAILED;
+  p = skip_CELtext_integer(p, end);
+  if(p == NULL) return CEL_READ_VALUE_FAILED;
+  while((p < end) && ((*p == ' ') || (*p == '\t'))) p++;
+  // Read the mean intensity:
+  if(parse_CELtext_float(p, end, intensity) == NULL) return CEL_READ_VALUE_FAILED;
+  return CEL_READ_VALUE_OK;
+}
+
+char is_CELtext_section_end(const char *line, size_t length){
+  size_t i;
+  // A blank line or a new section marks the end of a section's rows:
+  for(i=0; (i < length) && (isspace((unsigned char)line[i])); i++);
+  if((i == length) || (line[i] == '[')) return 1;
+  return 0;
+}
+
+char check_CELtext_section_end(CELtext_reader *r){
+  long offset = tell_CELtext_reader(r);
+  char *line;
+  size_t length;
+  line = next_CELtext_line(r, &length);
+  if(line == NULL) return CEL_READ_VALUE_OK;
+  if(is_CELtext_section_end(line, length) != 1) return CEL_READ_VALUE_FAILED;
+  return seek_CELtext_reader(r, offset);
+}
+
+void *parse_CELtext_chunk(void *arg){
+  CELtext_chunk *c = (CELtext_chunk*)arg;
+  CELtext_reader r;
+  char *buffer = NULL;
+  char *line;
+  size_t length, n = 0;
+  long line_offset;
+  float intensities[CEL_INTENSITY_BLOCK_SIZE];
+  c->status = CEL_TEXT_CHUNK_FAILED;
+  c->rows = 0;
+  init_CELstats(&c->stats, 0);
+  if(c->file.backend != CEL_BACKEND_MMAP){
+    buffer = (char*)malloc(CEL_TEXT_BUFFER_SIZE * sizeof(char));
+    if(buffer == NULL) return NULL;
+  }
+  // Each chunk owns the lines that start inside it, so skip the line that straddles its start:
+  if(open_CELtext_range_reader(&r, c->file, c->begin - 1, buffer, CEL_TEXT_BUFFER_SIZE) != CEL_READ_VALUE_OK){
+    free(buffer);
+    return NULL;
+  }
+  if(skip_CELtext_lines(&r, 1) != CEL_READ_VALUE_OK){
+    free(buffer);
+    return NULL;
+  }
+  c->status = CEL_TEXT_CHUNK_OPEN;
+  while(1){
+    line_offset = tell_CELtext_reader(&r);
+    if(line_offset >= c->end) break;
+    line = next_CELtext_line(&r, &length);
+    if(line == NULL) break;
+    if(is_CELtext_section_end(line, length) == 1){
+      c->status = CEL_TEXT_CHUNK_END;
+      c->section_end = line_offset;
+      break;
+    }
+    if(parse_CELtext_row(line, length, &intensities[n]) != CEL_READ_VALUE_OK){
+      c->status = CEL_TEXT_CHUNK_FAILED;
+      break;
+    }
+    c->rows++;
+    n++;
+    if(n == CEL_INTENSITY_BLOCK_SIZE){
+      feed_CELstats(&c->stats, intensities, n);
+      n = 0;
+    }
+  }
+  feed_CELstats(&c->stats, intensities, n);
+  if(buffer != NULL) free(buffer);
+  return NULL;
+}
+
+int count_CELtext_chunks(CELfile f, long start){
+  long size = size_CELfile(f);
+  int chunk_number;
+  // Fingerprints and visitors depend on the order of every value, so such files are parsed in one piece:
+  if((f.threads < 2) || (size <= start) || (is_CELfile_positional(f) != 1) || (f.fingerprint == 1) || (f.visit != NULL)) return 1;
+  chunk_number = (size - start) / CEL_TEXT_CHUNK_MIN;
+  if(chunk_number > f.threads) chunk_number = f.threads;
+  if(chunk_number < 1) chunk_number = 1;
+  return chunk_number;
+}
+
+// Estimate where a section of n rows starting at the reader's position ends, from the length of the rows
+// already buffered (or give the end of the file if there are none):
+static long estimate_CELtext_section_end(CELtext_reader *r, unsigned int n, long size){
+  char *p, *last = NULL, *end;
+  size_t lines = 0;
+  long estimate;
+  p = r->data + r->start;
+  end = r->data + r->end;
+  while((p < end) && ((p = memchr(p, '\n', end - p)) != NULL)){
+    last = p++;
+    lines++;
+  }
+  if(lines == 0) return size;
+  estimate = tell_CELtext_reader(r) + (long)(((double)(last + 1 - (r->data + r->start)) / lines) * n);
+  if((estimate <= tell_CELtext_reader(r)) || (estimate > size)) return size;
+  return estimate;
+}
+
+char readCELtext_intensity_parallel(CELtext_reader *r, unsigned int intensity_number, CELdata *d){
+  CELtext_chunk *chunks;
+  pthread_t *threads;
+  char *started;
+  CELstats stats;
+  long start, size, split_end, section_end;
+  size_t rows;
+  int i, chunk_number;
+  char result = CEL_READ_VALUE_FAILED;
+  start = tell_CELtext_reader(r);
+  size = size_CELfile(r->file);
+  chunk_number = count_CELtext_chunks(r->file, start);
+  if(chunk_number < 1) return CEL_READ_VALUE_FAILED;
+  // Only the intensity section is split, so that no thread starts in the sections after it:
+  split_end = estimate_CELtext_section_end(r, intensity_number, size);
+  if(chunk_number > (split_end - start) / CEL_TEXT_CHUNK_MIN) chunk_number = (split_end - start) / CEL_TEXT_CHUNK_MIN;
+  if(chunk_number < 1) chunk_number = 1;
+  chunks = (CELtext_chunk*)malloc(chunk_number * sizeof(CELtext_chunk));
+  threads = (pthread_t*)malloc(chunk_number * sizeof(pthread_t));
+  started = (char*)malloc(chunk_number * sizeof(char));
+  if((chunks == NULL) || (threads == NULL) || (started == NULL)){
+    free(chunks);
+    free(threads);
+    free(started);
+    return CEL_READ_VALUE_FAILED;
+  }
+  // Split the estimated section into equal byte ranges, each parsed by its own thread (the last runs on to the
+  // end of the section, wherever it turns out to be):
+  for(i=0; i<chunk_number; i++){
+    chunks[i].file = r->file;
+    chunks[i].begin = start + (((split_end - start) / chunk_number) * i);
+    chunks[i].end = start + (((split_end - start) / chunk_number) * (i + 1));
+    if(i == chunk_number - 1) chunks[i].end = size;
+    started[i] = (i > 0) && (pthread_create(&threads[i], NULL, parse_CELtext_chunk, &chunks[i]) == 0);
+  }
+  // Parse the first chunk (and any that could not be given a thread) on this thread:
+  for(i=0; i<chunk_number; i++){
+    if(started[i] == 1) pthread_join(threads[i], NULL);
+    else parse_CELtext_chunk(&chunks[i]);
+  }
+  // Merge the chunks in order, up to the one containing the end of the section:
+  init_CELstats(&stats, 0);
+  rows = 0;
+  section_end = size;
+  for(i=0; i<chunk_number; i++){
+    if(chunks[i].status == CEL_TEXT_CHUNK_FAILED) break;
+    merge_CELstats(&stats, &chunks[i].stats);
+    rows += chunks[i].rows;
+    if(chunks[i].status == CEL_TEXT_CHUNK_END){
+      section_end = chunks[i].section_end;
+      break;
+    }
+  }
+  if(((i == chunk_number) || (chunks[i].status != CEL_TEXT_CHUNK_FAILED)) && (rows == intensity_number)){
+    finish_CELstats(&stats, d);
+    result = seek_CELtext_reader(r, section_end);
+  }
+  free(chunks);
+  free(threads);
+  free(started);
+  return result;
+}
+
+void readCELtext_line(CELtext_reader *r, CELtext_current_state *state){
+  char *line;
+  size_t length;
   int n;
  
-  result = fgets(state->line, CEL_TEXT_MAX_LINE, f.handle);
-  if(result == NULL){
+  line = next_CELtext_line(r, &length);
+  if(line == NULL){
     state->line_type = CEL_TEXT_FAILED;
     return;
   }
+  if(length > CEL_TEXT_MAX_LINE - 1) length = CEL_TEXT_MAX_LINE - 1;
+  memcpy(state->line, line, length);
+  state->line[length] = '\0';
     
   //Read in the header if possible:
   n = sscanf(state->line, "[%[ABCDEFGHIJKLMNOPQRSTUVWXYZ]]", state->section);
@@ -47,10 +408,12 @@ void readCELtext_line(CELfile f, CELtext_current_state *state){
 
 char is_CELtext(CELfile f){
   CELtext_current_state state;
+  CELtext_reader r;
   reset_CELfile(f);
-  readCELtext_line(f, &state);
+  if(open_CELtext_reader(&r, f) != CEL_READ_VALUE_OK) return 0;
+  readCELtext_line(&r, &state);
   if((state.line_type != CEL_TEXT_HEADER_LINE) || (strcmp(state.section, "CEL") != 0)) return 0;
-  readCELtext_line(f, &state);
+  readCELtext_line(&r, &state);
   if((state.line_type != CEL_TEXT_TAG_LINE) || (strcmp(state.tag, "Version") != 0) || (strcmp(state.data, "3") != 0)) return 0;
   // All initial checks look good, to reset the file and return success:
   reset_CELfile(f);
@@ -58,14 +421,18 @@ char is_CELtext(CELfile f){
 }
 
 char readCELtext(CELfile f, CELdata *d, char read_intensity, char verbose){
-  unsigned int i, x, y, intensity_number;
-  float *intensities;
-  char data_line[CEL_TEXT_MAX_LINE + 1];
+  unsigned int i, n, intensity_number;
+  float intensities[CEL_INTENSITY_BLOCK_SIZE];
+  CELstats stats;
   CELtext_current_state state;
-  char *p, *result;
+  CELtext_reader r;
+  char *p, *line;
+  size_t length;
   d->valid = 0;
+  reset_CELfile(f);
+  if(open_CELtext_reader(&r, f) != CEL_READ_VALUE_OK) return 1;
   while(1){
-    readCELtext_line(f, &state);
+    readCELtext_line(&r, &state);
     if(state.line_type == CEL_TEXT_FAILED) break;
     
     if((state.line_type == CEL_TEXT_TAG_LINE) && (strcmp(state.section, "HEADER") == 0)){
@@ -94,50 +461,52 @@ char readCELtext(CELfile f, CELdata *d, char read_intensity, char verbose){
     
     if((state.line_type == CEL_TEXT_HEADER_LINE) && (strcmp(state.section, "INTENSITY") == 0)){
       intensity_number = 0;
-      readCELtext_line(f, &state);
+      readCELtext_line(&r, &state);
       if(strcmp(state.tag, "NumberCells") != 0) return 1;
       sscanf(state.data, "%d", &intensity_number);
-      if (read_intensity == 1) {
-        intensities = (float*)malloc(intensity_number * sizeof(float));
-        if(intensities == NULL) return 1;
-        result = fgets(data_line, CEL_TEXT_MAX_LINE, f.handle);
-        if(result == NULL){
-          free(intensities);
-          intensities = NULL;
-          return 1;
-        }
+      // Skip the column header line:
+      if(skip_CELtext_lines(&r, 1) != CEL_READ_VALUE_OK) return 1;
+      enter_CELprofile(CEL_PROFILE_PAYLOAD);
+      if((read_intensity == 1) && (count_CELtext_chunks(f, tell_CELtext_reader(&r)) > 1)){
+        // Large sections are split between threads:
+        if(readCELtext_intensity_parallel(&r, intensity_number, d) != CEL_READ_VALUE_OK) return 1;
+      } else if (read_intensity == 1) {
+        // Pass the intensities to the statistics a block at a time:
+        init_CELstats(&stats, f.fingerprint);
+        visit_CELstats(&stats, f.visit, f.visit_arg);
+        n = 0;
         for(i=0; i<intensity_number; i++){
-          result = fgets(data_line, CEL_TEXT_MAX_LINE, f.handle);
-          if(result == NULL){
-            free(intensities);
-            intensities = NULL;
-            return 1;
+          line = next_CELtext_line(&r, &length);
+          if(line == NULL) return 1;
+          if(parse_CELtext_row(line, length, &intensities[n]) != CEL_READ_VALUE_OK) return 1;
+          n++;
+          if(n == CEL_INTENSITY_BLOCK_SIZE){
+            feed_CELstats(&stats, intensities, n);
+            n = 0;
           }
-          sscanf(data_line, "%d%d%f", &x, &y, &intensities[i]);
         }
-        calculate_intensity_stats(intensities, intensity_number, &d->intensity_max, &d->intensity_min, &d->intensity_n_unique, &d->intensity_n_invalid);
-        d->intensity_stats_calculated = 1;
-        free(intensities);
-        intensities = NULL;
-      } else {
-        for(i=0; i<intensity_number; i++) if(fgets(data_line, CEL_TEXT_MAX_LINE, f.handle) == NULL) return 1;
-      }
+        feed_CELstats(&stats, intensities, n);
+        finish_CELstats(&stats, d);
+      } else if(skip_CELtext_lines(&r, intensity_number) != CEL_READ_VALUE_OK) return 1;
+      // There must be exactly NumberCells rows:
+      if(check_CELtext_section_end(&r) != CEL_READ_VALUE_OK) return 1;
+      enter_CELprofile(CEL_PROFILE_HEADER);
       continue;
     }
 
     if((state.line_type == CEL_TEXT_HEADER_LINE) && (strcmp(state.section, "MASKS") == 0)){
-      readCELtext_line(f, &state);
+      readCELtext_line(&r, &state);
       if(strcmp(state.tag, "NumberCells") != 0) return 1;
       sscanf(state.data, "%d", &d->masked);
-      for(i=0; i<d->masked; i++) if(fgets(data_line, CEL_TEXT_MAX_LINE, f.handle) == NULL) return 1;
+      if(skip_CELtext_lines(&r, d->masked) != CEL_READ_VALUE_OK) return 1;
       continue;
     }
     
     if((state.line_type == CEL_TEXT_HEADER_LINE) && (strcmp(state.section, "OUTLIERS") == 0)){
-      readCELtext_line(f, &state);
+      readCELtext_line(&r, &state);
       if(strcmp(state.tag, "NumberCells") != 0) return 1;
       sscanf(state.data, "%d", &d->outliers);
-      for(i=0; i<d->outliers; i++) if(fgets(data_line, CEL_TEXT_MAX_LINE, f.handle) == NULL) return 1;
+      if(skip_CELtext_lines(&r, d->outliers) != CEL_READ_VALUE_OK) return 1;
       continue;
     }
   }  
@@ -21,6 +21,10 @@
 #define CEL_TEXT_MAX_LINE 10000
 #define CEL_TEXT_HEADER_MAX 250
 
+//Define the size of the text read buffer and the longest number parsed:
+#define CEL_TEXT_BUFFER_SIZE 262144
+#define CEL_TEXT_NUMBER_MAX 63
+
 // Define the different line types:
 #define CEL_TEXT_UNKNOWN_LINE 0
 #define CEL_TEXT_HEADER_LINE 1
@@ -35,7 +39,58 @@ typedef struct {
   char data[CEL_TEXT_MAX_LINE + 1];
 } CELtext_current_state;
 
-void readCELtext_line(CELfile f, CELtext_current_state *state);
+// Define the struct holding a buffered reader over a text CEL file:
+typedef struct {
+  CELfile file;
+  char *data;
+  size_t start;
+  size_t end;
+  size_t size;
+  long offset;
+  char eof;
+  char positional;
+} CELtext_reader;
+
+// Functions to read lines through a text reader:
+char open_CELtext_reader(CELtext_reader *r, CELfile f);
+char open_CELtext_range_reader(CELtext_reader *r, CELfile f, long offset, char *buffer, size_t size);
+long tell_CELtext_reader(CELtext_reader *r);
+char seek_CELtext_reader(CELtext_reader *r, long offset);
+char *next_CELtext_line(CELtext_reader *r, size_t *length);
+char skip_CELtext_lines(CELtext_reader *r, size_t n);
+
+// Function to read the mean intensity from an "X Y MEAN STDV NPIXELS" row:
+char parse_CELtext_row(const char *line, size_t length, float *intensity);
+
+void readCELtext_line(CELtext_reader *r, CELtext_current_state *state);
+
+//Define the smallest share of an intensity section given to each thread:
+#define CEL_TEXT_CHUNK_MIN 1048576
+
+//Define the states of a parsed intensity chunk:
+#define CEL_TEXT_CHUNK_OPEN 0
+#define CEL_TEXT_CHUNK_END 1
+#define CEL_TEXT_CHUNK_FAILED 2
+
+// Define the struct holding a byte range of an intensity section and its partial statistics:
+typedef struct {
+  CELfile file;
+  long begin;
+  long end;
+  char status;
+  long section_end;
+  size_t rows;
+  CELstats stats;
+} CELtext_chunk;
+
+// Functions to check for the end of a section's rows:
+char is_CELtext_section_end(const char *line, size_t length);
+char check_CELtext_section_end(CELtext_reader *r);
+
+// Functions to parse an intensity section in parallel chunks:
+int count_CELtext_chunks(CELfile f, long start);
+void *parse_CELtext_chunk(void *arg);
+char readCELtext_intensity_parallel(CELtext_reader *r, unsigned int intensity_number, CELdata *d);
 
 char is_CELtext(CELfile f);
 char readCELtext(CELfile f, CELdata *d, char read_intensity, char verbose);
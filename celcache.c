@@ -0,0 +1,335 @@
+// checkcel - check the validity of an Affymetrix CEL file.
+// Copyright (C) 2016 Alastair Droop, The Leeds MRC Medical Bioinformatics Centre <a.p.droop@leeds.ac.uk>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cel.h"
+
+#ifdef __APPLE__
+#define CEL_CACHE_MTIME_NSEC(info) ((info).st_mtimespec.tv_nsec)
+#else
+#define CEL_CACHE_MTIME_NSEC(info) ((info).st_mtim.tv_nsec)
+#endif
+
+// Define the number of slots added at a time to the list of records added since the cache was opened:
+#define CEL_CACHE_ADDED_STEP 256
+
+// Round a record length up to keep every record aligned:
+#define CEL_CACHE_ALIGN(n) (((n) + 7) & ~((size_t)7))
+
+// Hash a path (64-bit FNV-1a):
+static u_int64_t hash_CELcache_path(const char *path, size_t n){
+  u_int64_t hash = 14695981039346656037ULL;
+  size_t i;
+  for(i=0; i<n; i++){
+    hash ^= (unsigned char)path[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// Check that the record at the given offset is complete and consistent, returning its length (or 0):
+static size_t check_CELcache_record(CELcache *c, size_t offset){
+  CELcache_record *record;
+  size_t strings;
+  if(c->map_size - offset < sizeof(CELcache_record)) return 0;
+  record = (CELcache_record*)(c->map + offset);
+  if((record->length < sizeof(CELcache_record)) || (record->length % 8 != 0)) return 0;
+  if(record->length > c->map_size - offset) return 0;
+  if((record->path_length == 0) || (record->array_length > record->length) || (record->algorithm_length > record->length)) return 0;
+  strings = (size_t)record->path_length + record->array_length + record->algorithm_length;
+  if(sizeof(CELcache_record) + strings > record->length) return 0;
+  return record->length;
+}
+
+// Find the index slot for a path, which is either empty or holds the latest record for it:
+static CELcache_record **find_CELcache_slot(CELcache *c, const char *path, size_t n){
+  size_t i, mask = c->slot_number - 1;
+  i = hash_CELcache_path(path, n) & mask;
+  while(c->slots[i] != NULL){
+    if((c->slots[i]->path_length == n) && (memcmp((char*)(c->slots[i] + 1), path, n) == 0)) break;
+    i = (i + 1) & mask;
+  }
+  return &c->slots[i];
+}
+
+// Index a record, replacing any earlier record for the same path and growing the index to keep it at most
+// half full:
+static char index_CELcache_record(CELcache *c, CELcache_record *record){
+  CELcache_record **slot, **old_slots;
+  size_t i, old_number;
+  slot = find_CELcache_slot(c, (char*)(record + 1), record->path_length);
+  if(*slot != NULL){
+    *slot = record;
+    return CEL_READ_VALUE_OK;
+  }
+  if((c->record_number + 1) * 2 > c->slot_number){
+    old_slots = c->slots;
+    old_number = c->slot_number;
+    c->slots = (CELcache_record**)calloc(old_number * 2, sizeof(CELcache_record*));
+    if(c->slots == NULL){
+      c->slots = old_slots;
+      return CEL_READ_VALUE_FAILED;
+    }
+    c->slot_number = old_number * 2;
+    for(i=0; i<old_number; i++){
+      if(old_slots[i] != NULL) *find_CELcache_slot(c, (char*)(old_slots[i] + 1), old_slots[i]->path_length) = old_slots[i];
+    }
+    free(old_slots);
+    slot = find_CELcache_slot(c, (char*)(record + 1), record->path_length);
+  }
+  *slot = record;
+  c->record_number++;
+  return CEL_READ_VALUE_OK;
+}
+
+CELcache *open_CELcache(char *path){
+  CELcache *c;
+  CELcache_header header;
+  CELcache_record *record;
+  struct stat info;
+  size_t offset, length, count = 0;
+  c = (CELcache*)malloc(sizeof(CELcache));
+  if(c == NULL) return NULL;
+  c->map = NULL;
+  c->map_size = 0;
+  c->slots = NULL;
+  c->slot_number = 0;
+  c->record_number = 0;
+  c->added = NULL;
+  c->added_number = 0;
+  c->added_size = 0;
+  c->fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+  if((c->fd < 0) || (fstat(c->fd, &info) != 0) || (!S_ISREG(info.st_mode))){
+    close_CELcache(c);
+    return NULL;
+  }
+  // New caches start with a header; anything else must already be a cache of the same layout:
+  memset(&header, 0, sizeof(CELcache_header));
+  memcpy(header.magic, CEL_CACHE_MAGIC, sizeof(header.magic));
+  header.version = CEL_CACHE_VERSION;
+  header.record_size = sizeof(CELcache_record);
+  if(info.st_size == 0){
+    if(write(c->fd, &header, sizeof(CELcache_header)) != sizeof(CELcache_header)){
+      close_CELcache(c);
+      return NULL;
+    }
+    info.st_size = sizeof(CELcache_header);
+  }
+  if(info.st_size < (off_t)sizeof(CELcache_header)){
+    close_CELcache(c);
+    return NULL;
+  }
+  c->map_size = info.st_size;
+  c->map = (unsigned char*)mmap(NULL, c->map_size, PROT_READ, MAP_SHARED, c->fd, 0);
+  if(c->map == MAP_FAILED){
+    c->map = NULL;
+    close_CELcache(c);
+    return NULL;
+  }
+  if(memcmp(c->map, &header, sizeof(CELcache_header)) != 0){
+    close_CELcache(c);
+    return NULL;
+  }
+  // Count the complete records. A run that stopped part way through an append leaves a partial record,
+  // which is cut off so that new records follow the last good one:
+  offset = sizeof(CELcache_header);
+  while((length = check_CELcache_record(c, offset)) > 0){
+    offset += length;
+    count++;
+  }
+  if(offset < c->map_size){
+    if(ftruncate(c->fd, offset) != 0){
+      close_CELcache(c);
+      return NULL;
+    }
+    c->map_size = offset;
+  }
+  // Index the records by path, sizing the table for them all at the start:
+  c->slot_number = 16;
+  while(c->slot_number < count * 2) c->slot_number *= 2;
+  c->slots = (CELcache_record**)calloc(c->slot_number, sizeof(CELcache_record*));
+  if(c->slots == NULL){
+    close_CELcache(c);
+    return NULL;
+  }
+  for(offset = sizeof(CELcache_header); offset < c->map_size; offset += record->length){
+    record = (CELcache_record*)(c->map + offset);
+    index_CELcache_record(c, record);
+  }
+  pthread_mutex_init(&c->lock, NULL);
+  return c;
+}
+
+void close_CELcache(CELcache *c){
+  size_t i;
+  if(c == NULL) return;
+  if(c->slots != NULL) pthread_mutex_destroy(&c->lock);
+  if(c->map != NULL) munmap(c->map, c->map_size);
+  if(c->fd >= 0) close(c->fd);
+  for(i=0; i<c->added_number; i++) free(c->added[i]);
+  free(c->added);
+  free(c->slots);
+  free(c);
+}
+
+char get_CELcache_key(char *path, char mode, CELcache_key *k){
+  struct stat info;
+  k->path = NULL;
+  if((stat(path, &info) != 0) || (!S_ISREG(info.st_mode))) return CEL_READ_VALUE_FAILED;
+  // Files are identified by their absolute path, so the cache works from any directory:
+  k->path = realpath(path, NULL);
+  if(k->path == NULL) return CEL_READ_VALUE_FAILED;
+  k->size = info.st_size;
+  k->mtime = info.st_mtime;
+  k->mtime_nsec = CEL_CACHE_MTIME_NSEC(info);
+  k->inode = info.st_ino;
+  k->mode = mode;
+  return CEL_READ_VALUE_OK;
+}
+
+void free_CELcache_key(CELcache_key *k){
+  if(k->path != NULL){
+    free(k->path);
+    k->path = NULL;
+  }
+}
+
+// Copy a cached string (a zero length means NULL):
+static char *copy_CELcache_string(const char *data, u_int32_t length){
+  char *s;
+  if(length == 0) return NULL;
+  s = (char*)malloc(length);
+  if(s == NULL) return NULL;
+  memcpy(s, data, length);
+  s[length - 1] = '\0';
+  return s;
+}
+
+// Check that a record is for the file given by a key, unchanged and checked in the same way:
+static char match_CELcache_record(CELcache_record *record, CELcache_key *k){
+  if(record == NULL) return 0;
+  if((record->size != k->size) || (record->mtime != k->mtime) || (record->mtime_nsec != k->mtime_nsec)) return 0;
+  if((record->inode != k->inode) || (record->mode != k->mode)) return 0;
+  return 1;
+}
+
+char find_CELcache(CELcache *c, CELcache_key *k, CELdata *d){
+  CELcache_record *record;
+  char *strings;
+  pthread_mutex_lock(&c->lock);
+  record = *find_CELcache_slot(c, k->path, strlen(k->path));
+  if(match_CELcache_record(record, k) != 1){
+    pthread_mutex_unlock(&c->lock);
+    return CEL_READ_VALUE_FAILED;
+  }
+  free_CELdata(d);
+  strings = (char*)(record + 1) + record->path_length;
+  d->array = copy_CELcache_string(strings, record->array_length);
+  strings += record->array_length;
+  d->algorithm = copy_CELcache_string(strings, record->algorithm_length);
+  d->valid = record->valid;
+  d->type = record->type;
+  d->intensity_stats_calculated = record->intensity_stats_calculated;
+  d->rows = record->rows;
+  d->cols = record->cols;
+  d->cell_margin = record->cell_margin;
+  d->outliers = record->outliers;
+  d->masked = record->masked;
+  d->intensity_min = record->intensity_min;
+  d->intensity_max = record->intensity_max;
+  d->intensity_n_unique = record->intensity_n_unique;
+  d->intensity_n_invalid = record->intensity_n_invalid;
+  d->intensity_hash_calculated = record->intensity_hash_calculated;
+  d->intensity_hash = record->intensity_hash;
+  pthread_mutex_unlock(&c->lock);
+  return CEL_READ_VALUE_OK;
+}
+
+char add_CELcache(CELcache *c, CELcache_key *k, CELdata *d){
+  CELcache_record *record, **added;
+  size_t path_length, array_length = 0, algorithm_length = 0, length;
+  char *p;
+  ssize_t written;
+  path_length = strlen(k->path);
+  if(d->array != NULL) array_length = strlen(d->array) + 1;
+  if(d->algorithm != NULL) algorithm_length = strlen(d->algorithm) + 1;
+  length = sizeof(CELcache_record) + path_length + array_length + algorithm_length;
+  length = CEL_CACHE_ALIGN(length);
+  if(length > UINT32_MAX) return CEL_READ_VALUE_FAILED;
+  record = (CELcache_record*)calloc(1, length);
+  if(record == NULL) return CEL_READ_VALUE_FAILED;
+  record->length = length;
+  record->path_length = path_length;
+  record->array_length = array_length;
+  record->algorithm_length = algorithm_length;
+  record->size = k->size;
+  record->mtime = k->mtime;
+  record->mtime_nsec = k->mtime_nsec;
+  record->inode = k->inode;
+  record->mode = k->mode;
+  record->valid = d->valid;
+  record->type = d->type;
+  record->intensity_stats_calculated = d->intensity_stats_calculated;
+  record->rows = d->rows;
+  record->cols = d->cols;
+  record->cell_margin = d->cell_margin;
+  record->outliers = d->outliers;
+  record->masked = d->masked;
+  record->intensity_min = d->intensity_min;
+  record->intensity_max = d->intensity_max;
+  record->intensity_n_unique = d->intensity_n_unique;
+  record->intensity_n_invalid = d->intensity_n_invalid;
+  record->intensity_hash_calculated = d->intensity_hash_calculated;
+  record->intensity_hash = d->intensity_hash;
+  p = (char*)(record + 1);
+  memcpy(p, k->path, path_length);
+  p += path_length;
+  if(array_length > 0) memcpy(p, d->array, array_length);
+  p += array_length;
+  if(algorithm_length > 0) memcpy(p, d->algorithm, algorithm_length);
+  // Each record is appended in a single write, so that concurrent checks cannot interleave. A file that
+  // another check has just stored is not written again:
+  pthread_mutex_lock(&c->lock);
+  if(match_CELcache_record(*find_CELcache_slot(c, k->path, path_length), k) == 1){
+    pthread_mutex_unlock(&c->lock);
+    free(record);
+    return CEL_READ_VALUE_OK;
+  }
+  written = write(c->fd, record, length);
+  if(written != length){
+    pthread_mutex_unlock(&c->lock);
+    free(record);
+    return CEL_READ_VALUE_FAILED;
+  }
+  // The record is kept (and indexed) so that later requests to a server find it:
+  if(c->added_number == c->added_size){
+    added = (CELcache_record**)realloc(c->added, (c->added_size + CEL_CACHE_ADDED_STEP) * sizeof(CELcache_record*));
+    if(added != NULL){
+      c->added = added;
+      c->added_size += CEL_CACHE_ADDED_STEP;
+    }
+  }
+  if((c->added_number < c->added_size) && (index_CELcache_record(c, record) == CEL_READ_VALUE_OK)){
+    c->added[c->added_number++] = record;
+  } else free(record);
+  pthread_mutex_unlock(&c->lock);
+  return CEL_READ_VALUE_OK;
+}
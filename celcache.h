@@ -0,0 +1,96 @@
+// checkcel - check the validity of an Affymetrix CEL file.
+// Copyright (C) 2016 Alastair Droop, The Leeds MRC Medical Bioinformatics Centre <a.p.droop@leeds.ac.uk>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __checkcel_celcache_h
+#define __checkcel_celcache_h
+
+// Define the cache file identifier and layout version:
+#define CEL_CACHE_MAGIC "CELCACHE"
+#define CEL_CACHE_VERSION 2
+
+// Define the header written once at the start of a cache file:
+typedef struct {
+  char magic[8];
+  u_int32_t version;
+  u_int32_t record_size;
+} CELcache_header;
+
+// Define the fixed part of a cached result. Each record is followed by its path (unterminated) and its
+// array and algorithm strings (terminated, with a zero length for a NULL string), and padded to a
+// multiple of eight bytes. Later records replace earlier ones for the same path:
+typedef struct {
+  u_int32_t length;
+  u_int32_t path_length;
+  u_int32_t array_length;
+  u_int32_t algorithm_length;
+  int64_t size;
+  int64_t mtime;
+  int64_t mtime_nsec;
+  u_int64_t inode;
+  char mode;
+  char valid;
+  char type;
+  char intensity_stats_calculated;
+  int32_t rows;
+  int32_t cols;
+  int32_t cell_margin;
+  u_int32_t outliers;
+  u_int32_t masked;
+  float intensity_min;
+  float intensity_max;
+  int32_t intensity_n_unique;
+  int32_t intensity_n_invalid;
+  char intensity_hash_calculated;
+  u_int64_t intensity_hash;
+} CELcache_record;
+
+// Define the identity of a file on disk, and the options it was checked with:
+typedef struct {
+  char *path;
+  int64_t size;
+  int64_t mtime;
+  int64_t mtime_nsec;
+  u_int64_t inode;
+  char mode;
+} CELcache_key;
+
+// Define the struct holding an open cache. The records present when it was opened are mapped, and results
+// added later are appended to the file for the next run and kept in memory for this one. Both are indexed
+// by path, with the index and added records guarded by the lock:
+typedef struct {
+  int fd;
+  unsigned char *map;
+  size_t map_size;
+  CELcache_record **slots;
+  size_t slot_number;
+  size_t record_number;
+  CELcache_record **added;
+  size_t added_number;
+  size_t added_size;
+  pthread_mutex_t lock;
+} CELcache;
+
+// Functions to open and close a cache file:
+CELcache *open_CELcache(char *path);
+void close_CELcache(CELcache *c);
+
+// Functions to identify a file, and to find and store its results:
+char get_CELcache_key(char *path, char mode, CELcache_key *k);
+void free_CELcache_key(CELcache_key *k);
+char find_CELcache(CELcache *c, CELcache_key *k, CELdata *d);
+char add_CELcache(CELcache *c, CELcache_key *k, CELdata *d);
+
+#endif
@@ -0,0 +1,208 @@
+// checkcel - check the validity of an Affymetrix CEL file.
+// Copyright (C) 2016 Alastair Droop, The Leeds MRC Medical Bioinformatics Centre <a.p.droop@leeds.ac.uk>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <stdio.h>
+#include <unistd.h>
+#include "cel.h"
+
+void init_CELresult(CELresult *r){
+  r->name = NULL;
+  r->next = NULL;
+  init_CELdata(&r->data);
+  init_CELprofile(&r->profile);
+}
+
+void free_CELresult(CELresult *r){
+  CELresult *next;
+  if(r->name != NULL){
+    free(r->name);
+    r->name = NULL;
+  }
+  free_CELdata(&r->data);
+  // Free any chained member results:
+  while(r->next != NULL){
+    next = r->next;
+    r->next = next->next;
+    next->next = NULL;
+    free_CELresult(next);
+    free(next);
+  }
+}
+
+// Find the mode a file's results are cached under, which covers the options that change them:
+static char get_CELcheck_cache_mode(CELcheck_options *o){
+  return o->read_intensity | (o->structural << 1) | (o->fingerprint << 2);
+}
+
+char is_CELpath_cached(char *path, CELcheck_options *o){
+  CELcache_key key;
+  CELdata d;
+  char found = 0;
+  if(o->cache == NULL) return 0;
+  if(get_CELcache_key(path, get_CELcheck_cache_mode(o), &key) == CEL_READ_VALUE_OK){
+    init_CELdata(&d);
+    if(find_CELcache(o->cache, &key, &d) == CEL_READ_VALUE_OK) found = 1;
+    free_CELdata(&d);
+  }
+  free_CELcache_key(&key);
+  return found;
+}
+
+void check_CELpath(char *path, CELcheck_options *o, CELresult *r){
+  check_CELpath_prefix(path, -1, NULL, 0, o, r);
+}
+
+// Files that have not been opened yet are given a negative descriptor:
+void check_CELpath_prefix(char *path, int fd, unsigned char *data, size_t size, CELcheck_options *o, CELresult *r){
+  CELfile f;
+  CELcache_key key;
+  char *name;
+  init_CELresult(r);
+  // Profiles cover everything from the cache lookup to closing the file (archives are profiled as a whole):
+  if(o->profile == 1) start_CELprofile(&r->profile);
+  // Results are named after the file name part of the path:
+  name = strrchr(path, '/');
+  if(name == NULL) name = path;
+  else name++;
+  r->name = (char*)malloc((strlen(name) + 1) * sizeof(char));
+  if(r->name != NULL) strcpy(r->name, name);
+  // Files that have not changed since they were last checked in the same way are answered from the cache:
+  key.path = NULL;
+  if((o->cache != NULL) && (get_CELcache_key(path, get_CELcheck_cache_mode(o), &key) == CEL_READ_VALUE_OK)){
+    if(find_CELcache(o->cache, &key, &r->data) == CEL_READ_VALUE_OK){
+      free_CELcache_key(&key);
+      if(fd >= 0){
+        close(fd);
+        free(data);
+      }
+      if(o->profile == 1) stop_CELprofile();
+      return;
+    }
+  }
+  if(fd >= 0) f = open_CELfile_prefix(path, fd, data, size);
+  else if(o->memory_map == 1) f = open_CELfile_mapped(path);
+  else f = open_CELfile(path);
+  // Archives are streamed, and checked member by member (their results are not cached):
+  if((f.open == 1) && (is_CELtar(f) == 1)){
+    if(f.backend == CEL_BACKEND_MMAP){
+      close_CELfile(f);
+      f = open_CELfile(path);
+    }
+    check_CELtar(f, o, r);
+  } else {
+    check_CELfile(f, o, r);
+    // Files that could not be opened or read (perhaps for want of descriptors or memory) may be fine on the
+    // next run, so their results are not kept:
+    if((key.path != NULL) && (is_CELfile_failed(f) != 1)) add_CELcache(o->cache, &key, &r->data);
+  }
+  enter_CELprofile(CEL_PROFILE_OPEN);
+  close_CELfile(f);
+  free_CELcache_key(&key);
+  if(o->profile == 1) stop_CELprofile();
+}
+
+void check_CELfile(CELfile f, CELcheck_options *o, CELresult *r){
+  f.threads = o->text_threads;
+  f.structural = o->structural;
+  f.fingerprint = o->fingerprint;
+  if(f.open == 1) readCEL(f, &r->data, o->read_intensity, 0);
+}
+
+void print_CELresult(FILE *stream, CELresult *r, CELcheck_options *o){
+  char *name;
+  CELresult *first;
+  first = r;
+  for(; r != NULL; r = r->next){
+    if((r == first) && (o->profiles != NULL)) add_CELprofiles(o->profiles, r->data.type, &r->profile);
+    if(o->duplicates != NULL){
+      add_CELfingerprints(o->duplicates, r);
+      continue;
+    }
+    if(o->columns != NULL){
+      if((r->data.valid == 1) || (o->filter_bad_files != 1)) add_CELcolumns(o->columns, r->name, &r->data);
+      continue;
+    }
+    name = r->name;
+    if(name == NULL) name = "";
+    if(r->data.valid == 1){
+      fprintf(stream, "%s\t", name);
+      fprint_CELdata_fields(stream, &r->data);
+    } else if(o->filter_bad_files != 1) fprintf(stream, "%s\tunknown", name);
+    else continue;
+    if(o->profile == 1) fprint_CELprofile(stream, &r->profile);
+    fprintf(stream, "\n");
+  }
+}
+
+CELfingerprints *create_CELfingerprints(){
+  CELfingerprints *fp;
+  fp = (CELfingerprints*)malloc(sizeof(CELfingerprints));
+  if(fp == NULL) return NULL;
+  fp->entries = NULL;
+  fp->n = 0;
+  fp->size = 0;
+  return fp;
+}
+
+void add_CELfingerprints(CELfingerprints *fp, CELresult *r){
+  CELfingerprint *entries;
+  size_t size;
+  if((r->data.valid != 1) || (r->data.intensity_hash_calculated != 1) || (r->name == NULL)) return;
+  if(fp->n == fp->size){
+    size = fp->size * 2;
+    if(size < 64) size = 64;
+    entries = (CELfingerprint*)realloc(fp->entries, size * sizeof(CELfingerprint));
+    if(entries == NULL) return;
+    fp->entries = entries;
+    fp->size = size;
+  }
+  fp->entries[fp->n].name = (char*)malloc((strlen(r->name) + 1) * sizeof(char));
+  if(fp->entries[fp->n].name == NULL) return;
+  strcpy(fp->entries[fp->n].name, r->name);
+  fp->entries[fp->n].hash = r->data.intensity_hash;
+  fp->entries[fp->n].order = fp->n;
+  fp->n++;
+}
+
+// Order fingerprints by hash, keeping files with the same hash in the order they were checked:
+static int compare_CELfingerprints(const void *a, const void *b){
+  const CELfingerprint *x = (const CELfingerprint*)a;
+  const CELfingerprint *y = (const CELfingerprint*)b;
+  if(x->hash != y->hash) return (x->hash < y->hash) ? -1 : 1;
+  if(x->order != y->order) return (x->order < y->order) ? -1 : 1;
+  return 0;
+}
+
+void print_CELfingerprints(FILE *stream, CELfingerprints *fp){
+  size_t i, j;
+  qsort(fp->entries, fp->n, sizeof(CELfingerprint), compare_CELfingerprints);
+  for(i=0; i<fp->n; i=j){
+    for(j=i+1; (j < fp->n) && (fp->entries[j].hash == fp->entries[i].hash); j++);
+    if(j - i < 2) continue;
+    fprintf(stream, "%016llx", (unsigned long long)fp->entries[i].hash);
+    for(; i<j; i++) fprintf(stream, "\t%s", fp->entries[i].name);
+    fprintf(stream, "\n");
+  }
+}
+
+void free_CELfingerprints(CELfingerprints *fp){
+  size_t i;
+  if(fp == NULL) return;
+  for(i=0; i<fp->n; i++) free(fp->entries[i].name);
+  free(fp->entries);
+  free(fp);
+}
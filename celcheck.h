@@ -0,0 +1,84 @@
+// checkcel - check the validity of an Affymetrix CEL file.
+// Copyright (C) 2016 Alastair Droop, The Leeds MRC Medical Bioinformatics Centre <a.p.droop@leeds.ac.uk>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __checkcel_celcheck_h
+#define __checkcel_celcheck_h
+
+// Define the struct collecting the fingerprints of checked files for the duplicate summary:
+typedef struct {
+  u_int64_t hash;
+  size_t order;
+  char *name;
+} CELfingerprint;
+
+typedef struct {
+  CELfingerprint *entries;
+  size_t n;
+  size_t size;
+} CELfingerprints;
+
+// Define the struct holding the options used when checking each file:
+typedef struct {
+  char read_intensity;
+  char filter_bad_files;
+  char memory_map;
+  char structural;
+  char fingerprint;
+  int text_threads;
+  CELcache *cache;
+  CELfingerprints *duplicates;
+  CELcolumns *columns;
+  char profile;
+  CELprofiles *profiles;
+  int prefetch;
+  int uring;
+} CELcheck_options;
+
+// Define the struct holding the result of checking a single file (archives chain one per member):
+typedef struct CELresult {
+  char *name;
+  CELdata data;
+  CELprofile profile;
+  struct CELresult *next;
+} CELresult;
+
+void init_CELresult(CELresult *r);
+void free_CELresult(CELresult *r);
+
+// Check whether a file's results can be answered from the cache without reading it:
+char is_CELpath_cached(char *path, CELcheck_options *o);
+
+// Check a single file (or each member of an archive), storing the result:
+void check_CELpath(char *path, CELcheck_options *o, CELresult *r);
+
+// Check a file whose descriptor and first block (a malloc()ed buffer of CEL_PREFIX_SIZE bytes) have already
+// been read, taking them over:
+void check_CELpath_prefix(char *path, int fd, unsigned char *data, size_t size, CELcheck_options *o, CELresult *r);
+
+// Check an already opened file, storing its data in the result:
+void check_CELfile(CELfile f, CELcheck_options *o, CELresult *r);
+
+// Write the output lines for a checked file (or collect its fingerprints for the duplicate summary, or its
+// rows for the columnar output). Profiled results add their profile columns, and their profile to the summary:
+void print_CELresult(FILE *stream, CELresult *r, CELcheck_options *o);
+
+// Functions to collect fingerprints, and write one line for each group of files sharing one:
+CELfingerprints *create_CELfingerprints();
+void add_CELfingerprints(CELfingerprints *fp, CELresult *r);
+void print_CELfingerprints(FILE *stream, CELfingerprints *fp);
+void free_CELfingerprints(CELfingerprints *fp);
+
+#endif
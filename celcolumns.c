@@ -0,0 +1,242 @@
+// checkcel - check the validity of an Affymetrix CEL file.
+// Copyright (C) 2016 Alastair Droop, The Leeds MRC Medical Bioinformatics Centre <a.p.droop@leeds.ac.uk>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include "cel.h"
+
+// Define the width in bytes of each fixed-size column, in file order (strings are 0):
+static const size_t CELcolumns_widths[CEL_COLUMNS_NUMBER] = {0, 1, 1, 0, 0, 4, 4, 4, 4, 4, 1, 4, 4, 4, 4, 1, 8};
+
+// Round a length up to the padding used throughout the file:
+static size_t pad_CELcolumns(size_t n){
+  return (n + 7) & ~((size_t)7);
+}
+
+static void put_CELcolumns_u32(unsigned char *p, u_int32_t value){
+  p[0] = value & 0xff;
+  p[1] = (value >> 8) & 0xff;
+  p[2] = (value >> 16) & 0xff;
+  p[3] = (value >> 24) & 0xff;
+}
+
+static void put_CELcolumns_u64(unsigned char *p, u_int64_t value){
+  put_CELcolumns_u32(p, value & 0xffffffff);
+  put_CELcolumns_u32(p + 4, value >> 32);
+}
+
+// Write bytes, remembering any failure:
+static void write_CELcolumns_bytes(CELcolumns *c, const void *data, size_t n){
+  if((c->failed == 1) || (n == 0)) return;
+  if(fwrite(data, 1, n, c->stream) != n) c->failed = 1;
+  c->position += n;
+}
+
+// Write the padding that completes a part of the given length:
+static void write_CELcolumns_padding(CELcolumns *c, size_t n){
+  static const unsigned char zero[8] = {0};
+  write_CELcolumns_bytes(c, zero, pad_CELcolumns(n) - n);
+}
+
+// Write a part followed by its padding:
+static void write_CELcolumns(CELcolumns *c, const void *data, size_t n){
+  write_CELcolumns_bytes(c, data, n);
+  write_CELcolumns_padding(c, n);
+}
+
+// Return the given string column of a row (missing strings are written empty):
+static const char *get_CELcolumns_string(CELcolumns_row *r, int column){
+  const char *s = NULL;
+  if(column == 0) s = r->name;
+  else if(column == 3) s = r->data.array;
+  else if(column == 4) s = r->data.algorithm;
+  if(s == NULL) s = "";
+  return s;
+}
+
+// Store the given fixed-size column of a row:
+static void put_CELcolumns_value(unsigned char *p, CELcolumns_row *r, int column){
+  CELdata *d = &r->data;
+  u_int32_t bits;
+  switch(column){
+    case 1: p[0] = d->valid; break;
+    case 2: p[0] = d->type; break;
+    case 5: put_CELcolumns_u32(p, d->rows); break;
+    case 6: put_CELcolumns_u32(p, d->cols); break;
+    case 7: put_CELcolumns_u32(p, d->cell_margin); break;
+    case 8: put_CELcolumns_u32(p, d->outliers); break;
+    case 9: put_CELcolumns_u32(p, d->masked); break;
+    case 10: p[0] = d->intensity_stats_calculated; break;
+    case 11:
+      memcpy(&bits, &d->intensity_min, 4);
+      put_CELcolumns_u32(p, bits);
+      break;
+    case 12:
+      memcpy(&bits, &d->intensity_max, 4);
+      put_CELcolumns_u32(p, bits);
+      break;
+    case 13: put_CELcolumns_u32(p, d->intensity_n_unique); break;
+    case 14: put_CELcolumns_u32(p, d->intensity_n_invalid); break;
+    case 15: p[0] = d->intensity_hash_calculated; break;
+    case 16: put_CELcolumns_u64(p, d->intensity_hash); break;
+  }
+}
+
+// Find the number of bytes a column takes in a batch of the buffered rows:
+static size_t size_CELcolumns_column(CELcolumns *c, int column){
+  size_t i, length = 0;
+  if(CELcolumns_widths[column] > 0) return pad_CELcolumns(c->n * CELcolumns_widths[column]);
+  for(i=0; i<c->n; i++) length += strlen(get_CELcolumns_string(&c->rows[i], column));
+  return pad_CELcolumns((c->n + 1) * 4) + pad_CELcolumns(length);
+}
+
+// Write the buffered rows as a batch, one column after another:
+static void flush_CELcolumns(CELcolumns *c){
+  unsigned char header[24];
+  unsigned char *buffer;
+  u_int64_t *batches;
+  u_int64_t length = sizeof(header);
+  size_t i, size, offset;
+  const char *s;
+  int column;
+  if(c->n == 0) return;
+  // Remember where the batch starts for the footer:
+  if(c->batch_number == c->batch_size){
+    size = c->batch_size * 2;
+    if(size < 16) size = 16;
+    batches = (u_int64_t*)realloc(c->batches, size * sizeof(u_int64_t));
+    if(batches == NULL) c->failed = 1;
+    else {
+      c->batches = batches;
+      c->batch_size = size;
+    }
+  }
+  if(c->failed == 0) c->batches[c->batch_number++] = c->position;
+  // Write the batch header, which gives the batch's length so that readers can step over it:
+  for(column=0; column<CEL_COLUMNS_NUMBER; column++) length += size_CELcolumns_column(c, column);
+  memcpy(header, CEL_COLUMNS_BATCH_MAGIC, 8);
+  put_CELcolumns_u32(header + 8, c->n);
+  put_CELcolumns_u32(header + 12, CEL_COLUMNS_NUMBER);
+  put_CELcolumns_u64(header + 16, length);
+  write_CELcolumns(c, header, sizeof(header));
+  // Fixed-size columns are packed arrays; string columns are n + 1 offsets into the bytes that follow them:
+  buffer = (unsigned char*)malloc((c->n + 1) * 8);
+  if(buffer == NULL) c->failed = 1;
+  for(column=0; (column<CEL_COLUMNS_NUMBER) && (c->failed == 0); column++){
+    if(CELcolumns_widths[column] > 0){
+      for(i=0; i<c->n; i++) put_CELcolumns_value(buffer + i * CELcolumns_widths[column], &c->rows[i], column);
+      write_CELcolumns(c, buffer, c->n * CELcolumns_widths[column]);
+      continue;
+    }
+    offset = 0;
+    for(i=0; i<c->n; i++){
+      put_CELcolumns_u32(buffer + i * 4, offset);
+      offset += strlen(get_CELcolumns_string(&c->rows[i], column));
+    }
+    put_CELcolumns_u32(buffer + c->n * 4, offset);
+    write_CELcolumns(c, buffer, (c->n + 1) * 4);
+    for(i=0; i<c->n; i++){
+      s = get_CELcolumns_string(&c->rows[i], column);
+      write_CELcolumns_bytes(c, s, strlen(s));
+    }
+    write_CELcolumns_padding(c, offset);
+  }
+  free(buffer);
+  // Release the rows:
+  for(i=0; i<c->n; i++){
+    free(c->rows[i].name);
+    free_CELdata(&c->rows[i].data);
+  }
+  c->row_total += c->n;
+  c->n = 0;
+}
+
+CELcolumns *create_CELcolumns(FILE *stream){
+  CELcolumns *c;
+  unsigned char header[16];
+  c = (CELcolumns*)malloc(sizeof(CELcolumns));
+  if(c == NULL) return NULL;
+  c->rows = (CELcolumns_row*)malloc(CEL_COLUMNS_BATCH_ROWS * sizeof(CELcolumns_row));
+  if(c->rows == NULL){
+    free(c);
+    return NULL;
+  }
+  c->stream = stream;
+  c->failed = 0;
+  c->position = 0;
+  c->row_total = 0;
+  c->n = 0;
+  c->batches = NULL;
+  c->batch_number = 0;
+  c->batch_size = 0;
+  // Write the file header:
+  memset(header, 0, sizeof(header));
+  memcpy(header, CEL_COLUMNS_MAGIC, strlen(CEL_COLUMNS_MAGIC));
+  put_CELcolumns_u32(header + 8, CEL_COLUMNS_VERSION);
+  put_CELcolumns_u32(header + 12, CEL_COLUMNS_NUMBER);
+  write_CELcolumns(c, header, sizeof(header));
+  return c;
+}
+
+// Copy a string, keeping missing strings missing:
+static char *copy_CELcolumns_string(const char *s){
+  char *copy;
+  if(s == NULL) return NULL;
+  copy = (char*)malloc((strlen(s) + 1) * sizeof(char));
+  if(copy != NULL) strcpy(copy, s);
+  return copy;
+}
+
+void add_CELcolumns(CELcolumns *c, char *name, CELdata *d){
+  CELcolumns_row *r = &c->rows[c->n];
+  r->name = copy_CELcolumns_string(name);
+  r->data = *d;
+  r->data.array = copy_CELcolumns_string(d->array);
+  r->data.algorithm = copy_CELcolumns_string(d->algorithm);
+  c->n++;
+  if(c->n == CEL_COLUMNS_BATCH_ROWS) flush_CELcolumns(c);
+}
+
+char finish_CELcolumns(CELcolumns *c){
+  unsigned char footer[CEL_COLUMNS_FOOTER_SIZE];
+  unsigned char offset[8];
+  size_t i;
+  flush_CELcolumns(c);
+  // The footer lists where each batch starts, and ends with a fixed-size trailer so it can be found from the end:
+  for(i=0; i<c->batch_number; i++){
+    put_CELcolumns_u64(offset, c->batches[i]);
+    write_CELcolumns(c, offset, 8);
+  }
+  put_CELcolumns_u64(footer, c->batch_number);
+  put_CELcolumns_u64(footer + 8, c->row_total);
+  memset(footer + 16, 0, 8);
+  memcpy(footer + 16, CEL_COLUMNS_MAGIC, strlen(CEL_COLUMNS_MAGIC));
+  write_CELcolumns(c, footer, sizeof(footer));
+  if(fflush(c->stream) != 0) c->failed = 1;
+  if(c->failed == 1) return CEL_READ_VALUE_FAILED;
+  return CEL_READ_VALUE_OK;
+}
+
+void free_CELcolumns(CELcolumns *c){
+  size_t i;
+  if(c == NULL) return;
+  for(i=0; i<c->n; i++){
+    free(c->rows[i].name);
+    free_CELdata(&c->rows[i].data);
+  }
+  free(c->rows);
+  free(c->batches);
+  free(c);
+}
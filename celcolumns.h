@@ -0,0 +1,55 @@
+// checkcel - check the validity of an Affymetrix CEL file.
+// Copyright (C) 2016 Alastair Droop, The Leeds MRC Medical Bioinformatics Centre <a.p.droop@leeds.ac.uk>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __checkcel_celcolumns_h
+#define __checkcel_celcolumns_h
+
+// Define the columnar output format (all values are little-endian, and every part is padded to 8 bytes):
+#define CEL_COLUMNS_MAGIC "CELCOLS"
+#define CEL_COLUMNS_BATCH_MAGIC "CELBATCH"
+#define CEL_COLUMNS_VERSION 1
+#define CEL_COLUMNS_NUMBER 17
+#define CEL_COLUMNS_FOOTER_SIZE 24
+
+// Define the number of files written in each batch:
+#define CEL_COLUMNS_BATCH_ROWS 65536
+
+// Define the struct holding a single buffered output row:
+typedef struct {
+  char *name;
+  CELdata data;
+} CELcolumns_row;
+
+// Define the struct holding a columnar output file, and the rows of the batch being collected:
+typedef struct {
+  FILE *stream;
+  char failed;
+  u_int64_t position;
+  u_int64_t row_total;
+  CELcolumns_row *rows;
+  size_t n;
+  u_int64_t *batches;
+  size_t batch_number;
+  size_t batch_size;
+} CELcolumns;
+
+// Functions to write checked files in the columnar format:
+CELcolumns *create_CELcolumns(FILE *stream);
+void add_CELcolumns(CELcolumns *c, char *name, CELdata *d);
+char finish_CELcolumns(CELcolumns *c);
+void free_CELcolumns(CELcolumns *c);
+
+#endif
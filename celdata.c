@@ -17,6 +17,10 @@
 #include <stdio.h>
 #include "cel.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 void init_CELdata(CELdata *d){
   d->valid = 0;
   d->type = CEL_TYPE_UNKNOWN;
@@ -32,6 +36,8 @@ void init_CELdata(CELdata *d){
   d->intensity_max = 0;
   d->intensity_n_unique = 0;
   d->intensity_n_invalid = 0;
+  d->intensity_hash_calculated = 0;
+  d->intensity_hash = 0;
 }
 
 void free_CELdata(CELdata *d){
@@ -55,6 +61,8 @@ void free_CELdata(CELdata *d){
   d->intensity_max = 0;
   d->intensity_n_unique = 0;
   d->intensity_n_invalid = 0;
+  d->intensity_hash_calculated = 0;
+  d->intensity_hash = 0;
 }
 #define CEL_TYPE_UNKNOWN 100
 #define CEL_TYPE_BINARY 101
@@ -62,16 +70,26 @@ void free_CELdata(CELdata *d){
 #define CEL_TYPE_TEXT 103
 
 void print_CELdata(CELdata *d){
+  fprint_CELdata(stdout, d);
+}
+
+void fprint_CELdata(FILE *stream, CELdata *d){
+  fprint_CELdata_fields(stream, d);
+  fprintf(stream, "\n");
+}
+
+void fprint_CELdata_fields(FILE *stream, CELdata *d){
   char *type_str = "unknown";
   if((d->valid != 1) || (d->type == CEL_TYPE_UNKNOWN)){
-    printf("(invalid)\n");
+    fprintf(stream, "(invalid)");
     return;
   }
   if(d->type == CEL_TYPE_BINARY) type_str = "binary";
   else if(d->type == CEL_TYPE_CALVIN) type_str = "calvin";
   else if(d->type == CEL_TYPE_TEXT) type_str = "text";
-  if(d->intensity_stats_calculated != 1) printf("%s\t%s\t%s\t%d\t%d\t%d\t%d\t%d\n", type_str, d->array, d->algorithm, d->rows, d->cols, d->cell_margin, d->outliers, d->masked);
-  else printf("%s\t%s\t%s\t%d\t%d\t%d\t%d\t%d\t%0.0f\t%0.0f\t%d\t%d\n", type_str, d->array, d->algorithm, d->rows, d->cols, d->cell_margin, d->outliers, d->masked, d->intensity_min, d->intensity_max, d->intensity_n_unique, d->intensity_n_invalid);
+  fprintf(stream, "%s\t%s\t%s\t%d\t%d\t%d\t%d\t%d", type_str, d->array, d->algorithm, d->rows, d->cols, d->cell_margin, d->outliers, d->masked);
+  if(d->intensity_stats_calculated == 1) fprintf(stream, "\t%0.0f\t%0.0f\t%d\t%d", d->intensity_min, d->intensity_max, d->intensity_n_unique, d->intensity_n_invalid);
+  if(d->intensity_hash_calculated == 1) fprintf(stream, "\t%016llx", (unsigned long long)d->intensity_hash);
 }
 
 void extract_chipname(char *str, CELdata *d){
@@ -93,34 +111,149 @@ void extract_chipname(char *str, CELdata *d){
   d->array[array_length - 1] = '\0';
 }
 
-void calculate_intensity_stats(float *data, size_t n, float *max_value, float *min_value, int *unique, int *invalid){
-  int i;
-  int unique_values[MAX_INTENSITY_VALUE + 1];
-  float curr_value;
-  if(data == NULL) return;
-  *min_value = MAX_INTENSITY_VALUE + 1;
-  *max_value = -1;
-  *unique = 0;
-  *invalid = 0;
-  memset(&unique_values, 0, (MAX_INTENSITY_VALUE + 1) * sizeof(int));
-  for(i=0; i < n; i++){
-    curr_value = data[i];
-    if(curr_value < 0){
-      (*invalid)++;
-      continue;
-    }
-    if(curr_value > MAX_INTENSITY_VALUE){
-      (*invalid)++;
+void init_CELstats(CELstats *s, char fingerprint){
+  s->n = 0;
+  s->invalid = 0;
+  s->min_value = MAX_INTENSITY_VALUE + 1;
+  s->max_value = -1;
+  memset(s->seen, 0, CEL_STATS_WORDS * sizeof(u_int64_t));
+  s->fingerprint = fingerprint;
+  if(fingerprint == 1) init_CELhash(&s->hash);
+  s->visit = NULL;
+  s->visit_arg = NULL;
+}
+
+void visit_CELstats(CELstats *s, CELvisit visit, void *arg){
+  s->visit = visit;
+  s->visit_arg = arg;
+}
+
+// Add a block of values to the fingerprint. Values are hashed as little-endian floats, so that the same
+// intensities give the same fingerprint on every machine and from every file format:
+static void hash_CELstats(CELstats *s, float *data, size_t n){
+  float block[CEL_INTENSITY_BLOCK_SIZE];
+  size_t i, m;
+  if(check_endian() == MACHINE_LITTLE_ENDIAN){
+    feed_CELhash(&s->hash, data, n * sizeof(float));
+    return;
+  }
+  for(i=0; i<n; i+=m){
+    m = n - i;
+    if(m > CEL_INTENSITY_BLOCK_SIZE) m = CEL_INTENSITY_BLOCK_SIZE;
+    swap_CEL_32(block, data + i, m);
+    feed_CELhash(&s->hash, block, m * sizeof(float));
+  }
+}
+
+// Find the range of the valid values in a block and count the invalid ones (including NaN):
+#ifdef __SSE2__
+static size_t range_CELstats(float *data, size_t n, float *min_value, float *max_value){
+  size_t i, valid_number;
+  int32_t counts[4];
+  float lows[4], highs[4];
+  __m128i valid_count = _mm_setzero_si128();
+  __m128 x, valid, lo, hi;
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 top = _mm_set1_ps(MAX_INTENSITY_VALUE);
+  const __m128 above = _mm_set1_ps(MAX_INTENSITY_VALUE + 1);
+  const __m128 below = _mm_set1_ps(-1);
+  lo = _mm_set1_ps(*min_value);
+  hi = _mm_set1_ps(*max_value);
+  for(i=0; i + 4 <= n; i += 4){
+    x = _mm_loadu_ps(data + i);
+    // Comparisons with NaN are false, so NaN is never valid:
+    valid = _mm_and_ps(_mm_cmpge_ps(x, zero), _mm_cmple_ps(x, top));
+    lo = _mm_min_ps(lo, _mm_or_ps(_mm_and_ps(valid, x), _mm_andnot_ps(valid, above)));
+    hi = _mm_max_ps(hi, _mm_or_ps(_mm_and_ps(valid, x), _mm_andnot_ps(valid, below)));
+    valid_count = _mm_sub_epi32(valid_count, _mm_castps_si128(valid));
+  }
+  _mm_storeu_ps(lows, lo);
+  _mm_storeu_ps(highs, hi);
+  _mm_storeu_si128((__m128i*)counts, valid_count);
+  valid_number = counts[0] + counts[1] + counts[2] + counts[3];
+  for(; i<n; i++){
+    if(!((data[i] >= 0) && (data[i] <= MAX_INTENSITY_VALUE))) continue;
+    if(data[i] < lows[0]) lows[0] = data[i];
+    if(data[i] > highs[0]) highs[0] = data[i];
+    valid_number++;
+  }
+  for(i=0; i<4; i++){
+    if(lows[i] < *min_value) *min_value = lows[i];
+    if(highs[i] > *max_value) *max_value = highs[i];
+  }
+  return n - valid_number;
+}
+#else
+static size_t range_CELstats(float *data, size_t n, float *min_value, float *max_value){
+  size_t i, invalid = 0;
+  for(i=0; i<n; i++){
+    if(!((data[i] >= 0) && (data[i] <= MAX_INTENSITY_VALUE))){
+      invalid++;
       continue;
     }
-    if(curr_value < *min_value) *min_value = curr_value;
-    if(curr_value > *max_value) *max_value = curr_value;
-    unique_values[(int)round(curr_value)] ++;    
+    if(data[i] < *min_value) *min_value = data[i];
+    if(data[i] > *max_value) *max_value = data[i];
+  }
+  return invalid;
+}
+#endif
+
+void feed_CELstats(CELstats *s, float *data, size_t n){
+  size_t i;
+  int value;
+  enter_CELprofile(CEL_PROFILE_STATS);
+  s->invalid += range_CELstats(data, n, &s->min_value, &s->max_value);
+  if(s->fingerprint == 1) hash_CELstats(s, data, n);
+  if((s->visit != NULL) && (n > 0)) s->visit(data, n, s->visit_arg);
+  // Mark each rounded valid value as seen (adding a half and truncating rounds halves away from zero):
+  for(i=0; i < n; i++){
+    if(!((data[i] >= 0) && (data[i] <= MAX_INTENSITY_VALUE))) continue;
+    value = (int)((double)data[i] + 0.5);
+    s->seen[value >> 6] |= ((u_int64_t)1) << (value & 63);
+  }
+  s->n += n;
+  enter_CELprofile(CEL_PROFILE_PAYLOAD);
+}
+
+void merge_CELstats(CELstats *s, CELstats *other){
+  int i;
+  s->n += other->n;
+  s->invalid += other->invalid;
+  if(other->min_value < s->min_value) s->min_value = other->min_value;
+  if(other->max_value > s->max_value) s->max_value = other->max_value;
+  for(i=0; i<CEL_STATS_WORDS; i++) s->seen[i] |= other->seen[i];
+}
+
+void finish_CELstats(CELstats *s, CELdata *d){
+  int i;
+  enter_CELprofile(CEL_PROFILE_STATS);
+  d->intensity_min = s->min_value;
+  d->intensity_max = s->max_value;
+  d->intensity_n_unique = 0;
+  d->intensity_n_invalid = s->invalid;
+  for(i=0; i<CEL_STATS_WORDS; i++) d->intensity_n_unique += __builtin_popcountll(s->seen[i]);
+  if(s->invalid == s->n){
+    d->intensity_n_unique = 0;
+    d->intensity_min = 0.0;
+    d->intensity_max = 0.0;
   }
-  for(i=0; i<MAX_INTENSITY_VALUE + 1; i++) if(unique_values[i] != 0) (*unique)++;
-  if(*invalid == n){
-    *unique = 0;
-    *min_value = 0.0;
-    *max_value = 0.0;
+  d->intensity_stats_calculated = 1;
+  if(s->fingerprint == 1){
+    d->intensity_hash = finish_CELhash(&s->hash);
+    d->intensity_hash_calculated = 1;
   }
+  enter_CELprofile(CEL_PROFILE_PAYLOAD);
+}
+
+void calculate_intensity_stats(float *data, size_t n, float *max_value, float *min_value, int *unique, int *invalid){
+  CELstats stats;
+  CELdata d;
+  if(data == NULL) return;
+  init_CELstats(&stats, 0);
+  feed_CELstats(&stats, data, n);
+  finish_CELstats(&stats, &d);
+  *max_value = d.intensity_max;
+  *min_value = d.intensity_min;
+  *unique = d.intensity_n_unique;
+  *invalid = d.intensity_n_invalid;
 }
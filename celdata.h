@@ -36,16 +36,49 @@ typedef struct {
   float intensity_max;
   int intensity_n_unique;
   int intensity_n_invalid;
+  char intensity_hash_calculated;
+  u_int64_t intensity_hash;
 } CELdata;
 
 
 void init_CELdata(CELdata *d);
 void free_CELdata(CELdata *d);
 void print_CELdata(CELdata *d);
+void fprint_CELdata(FILE *stream, CELdata *d);
+// Write the same fields without ending the line:
+void fprint_CELdata_fields(FILE *stream, CELdata *d);
 
 //Extract the chip name from a given string:
 void extract_chipname(char *str, CELdata *cel_data);
 
+// Define the number of intensity values passed to the statistics at once:
+#define CEL_INTENSITY_BLOCK_SIZE 4096
+
+// Define the function type shown each block of intensity values in file order:
+typedef void (*CELvisit)(const float *data, size_t n, void *arg);
+
+// Define the struct holding running intensity statistics (one bit per rounded value seen), and optionally
+// a fingerprint of the values in order and a visitor shown each block:
+#define CEL_STATS_WORDS ((MAX_INTENSITY_VALUE + 64) / 64)
+typedef struct {
+  size_t n;
+  size_t invalid;
+  float min_value;
+  float max_value;
+  u_int64_t seen[CEL_STATS_WORDS];
+  char fingerprint;
+  CELhash hash;
+  CELvisit visit;
+  void *visit_arg;
+} CELstats;
+
+// Functions to calculate intensity statistics incrementally (fingerprinted or visited statistics cannot be merged):
+void init_CELstats(CELstats *s, char fingerprint);
+void visit_CELstats(CELstats *s, CELvisit visit, void *arg);
+void feed_CELstats(CELstats *s, float *data, size_t n);
+void merge_CELstats(CELstats *s, CELstats *other);
+void finish_CELstats(CELstats *s, CELdata *d);
+
 // Calculate statistics from an array of intensity values:
 void calculate_intensity_stats(float *data, size_t n, float *max_value, float *min_value, int *unique, int *invalid);
 
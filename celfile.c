@@ -15,6 +15,11 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <stdio.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "cel.h"
 
 char check_endian(){
@@ -23,12 +28,30 @@ char check_endian(){
   return MACHINE_BIG_ENDIAN;
 }
 
-CELfile open_CELfile(char* path){
+// Set up the path and name of a new CELfile structure:
+static CELfile init_CELfile(char *path, char backend){
   CELfile f;
   // Set default values for the structure:
   f.open = 0;
+  f.type = CEL_TYPE_UNKNOWN;
+  f.backend = backend;
   f.path = NULL;
   f.name = NULL;
+  f.handle = NULL;
+  f.stream = NULL;
+  f.map = NULL;
+  f.prefix = NULL;
+  f.scratch = NULL;
+  f.threads = 1;
+  f.structural = 0;
+  f.fingerprint = 0;
+  f.visit = NULL;
+  f.visit_arg = NULL;
+  // Allocate the (initially empty) scratch buffer shared by all copies of the structure:
+  f.scratch = (CELscratch*)malloc(sizeof(CELscratch));
+  if(f.scratch == NULL) return f;
+  f.scratch->data = NULL;
+  f.scratch->size = 0;
   // Allocate memory for the full path:
   f.path = malloc((strlen(path) + 1) * sizeof(char));
   if(f.path == NULL){
@@ -42,22 +65,187 @@ CELfile open_CELfile(char* path){
   f.name = strrchr(f.path, '/');
   if(f.name == NULL) f.name = f.path;
   else f.name ++;
+  return f;
+}
+
+// Read the start of a buffered file's stream in one call, so that sniffing and header decoding need
+// no further I/O, and mark the file as open:
+static CELfile load_CELfile_prefix(CELfile f){
+  f.prefix = (CELprefix*)malloc(sizeof(CELprefix));
+  if(f.prefix == NULL) return f;
+  f.prefix->data = (unsigned char*)malloc(CEL_PREFIX_SIZE);
+  if(f.prefix->data == NULL) return f;
+  f.prefix->size = read_CELstream(f.stream, f.prefix->data, CEL_PREFIX_SIZE);
+  f.prefix->pos = 0;
+  // Set the file status to open:
+  f.open = 1;
+  return f;
+}
+
+CELfile open_CELfile(char* path){
   //  Attempt to open the file:
-  f.handle = fopen(f.path, "r");
-  if(f.handle == NULL){
-    fclose(f.handle);
-    f.open = 0;
+  return open_CELfile_handle(path, fopen(path, "r"));
+}
+
+CELfile open_CELfile_handle(char *path, FILE *handle){
+  CELfile f;
+  f = init_CELfile(path, CEL_BACKEND_STDIO);
+  if(handle == NULL) return f;
+  // The file takes over the handle:
+  f.handle = handle;
+  if(f.path == NULL) return f;
+  // Read through a decompressor if the file needs one:
+  f.stream = open_CELstream(f.handle);
+  if(f.stream == NULL) return f;
+  return load_CELfile_prefix(f);
+}
+
+CELfile open_CELfile_prefix(char *path, int fd, unsigned char *data, size_t size){
+  CELfile f;
+  FILE *handle;
+  // The file takes over the descriptor and the first block already read from it (a malloc()ed buffer of
+  // CEL_PREFIX_SIZE bytes):
+  handle = fdopen(fd, "r");
+  if(handle == NULL){
+    close(fd);
+    free(data);
+    return init_CELfile(path, CEL_BACKEND_STDIO);
+  }
+  // Compressed files need their decompressed start, so are read again from the beginning:
+  if(sniff_CELstream(data, size) != CEL_STREAM_FILE){
+    free(data);
+    return open_CELfile_handle(path, handle);
+  }
+  f = init_CELfile(path, CEL_BACKEND_STDIO);
+  f.handle = handle;
+  if(f.path == NULL){
+    free(data);
     return f;
   }
-  // Set the file status to open:
+  f.prefix = (CELprefix*)malloc(sizeof(CELprefix));
+  if(f.prefix == NULL){
+    free(data);
+    return f;
+  }
+  f.prefix->data = data;
+  f.prefix->size = size;
+  f.prefix->pos = 0;
+  // The block was read without moving the descriptor, so the stream starts at the beginning:
+  f.stream = open_CELstream_file(handle);
+  if(f.stream == NULL) return f;
+  f.open = 1;
+  return f;
+}
+
+CELfile open_CELfile_stream(char *path, CELstream *stream){
+  CELfile f;
+  f = init_CELfile(path, CEL_BACKEND_STDIO);
+  if(f.path == NULL){
+    close_CELstream(stream);
+    return f;
+  }
+  // The file takes over the stream, reading through a decompressor if it needs one:
+  f.stream = open_CELstream_decoder(stream);
+  if(f.stream == NULL){
+    close_CELstream(stream);
+    return f;
+  }
+  return load_CELfile_prefix(f);
+}
+
+CELfile open_CELfile_mapped(char* path){
+  CELfile f;
+  int fd;
+  struct stat info;
+  void *data;
+  f = init_CELfile(path, CEL_BACKEND_MMAP);
+  if(f.path == NULL) return f;
+  f.map = (CELmap*)malloc(sizeof(CELmap));
+  if(f.map == NULL) return f;
+  f.map->data = NULL;
+  f.map->size = 0;
+  f.map->pos = 0;
+  f.map->mapped = 1;
+  //  Attempt to open and map the file (empty files have nothing to map):
+  fd = open(f.path, O_RDONLY);
+  if(fd < 0) return f;
+  if((fstat(fd, &info) != 0) || (!S_ISREG(info.st_mode))){
+    close(fd);
+    return f;
+  }
+  if(info.st_size > 0){
+    data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(data == MAP_FAILED){
+      close(fd);
+      return f;
+    }
+    f.map->data = (unsigned char*)data;
+    f.map->size = info.st_size;
+  }
+  // The mapping remains valid once the descriptor is closed:
+  close(fd);
+  // Compressed files can only be streamed:
+  if(sniff_CELstream(f.map->data, f.map->size) != CEL_STREAM_FILE){
+    close_CELfile(f);
+    return open_CELfile(path);
+  }
+  f.open = 1;
+  return f;
+}
+
+CELfile open_CELfile_buffer(char *path, const void *data, size_t size){
+  CELfile f;
+  FILE *handle;
+  // Compressed buffers can only be streamed:
+  if(sniff_CELstream(data, size) != CEL_STREAM_FILE){
+    handle = fmemopen((void*)data, size, "r");
+    return open_CELfile_handle(path, handle);
+  }
+  f = init_CELfile(path, CEL_BACKEND_MMAP);
+  if(f.path == NULL) return f;
+  f.map = (CELmap*)malloc(sizeof(CELmap));
+  if(f.map == NULL) return f;
+  // The buffer is read in place, and still belongs to the caller:
+  f.map->data = (unsigned char*)data;
+  f.map->size = size;
+  f.map->pos = 0;
+  f.map->mapped = 0;
   f.open = 1;
   return f;
 }
 
+void prefetch_CELfile(char *path, off_t length){
+  int fd;
+  fd = open(path, O_RDONLY);
+  if(fd < 0) return;
+  // The kernel keeps reading after the descriptor is closed:
+  posix_fadvise(fd, 0, length, POSIX_FADV_WILLNEED);
+  close(fd);
+}
+
+void release_CELfile(char *path){
+  int fd;
+  fd = open(path, O_RDONLY);
+  if(fd < 0) return;
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+}
+
 void close_CELfile(CELfile f){
-  if(f.path != NULL){
-    free(f.path);
-    fclose(f.handle);
+  if(f.path != NULL) free(f.path);
+  if(f.stream != NULL) close_CELstream(f.stream);
+  if(f.handle != NULL) fclose(f.handle);
+  if(f.map != NULL){
+    if((f.map->mapped == 1) && (f.map->data != NULL)) munmap(f.map->data, f.map->size);
+    free(f.map);
+  }
+  if(f.prefix != NULL){
+    if(f.prefix->data != NULL) free(f.prefix->data);
+    free(f.prefix);
+  }
+  if(f.scratch != NULL){
+    if(f.scratch->data != NULL) free(f.scratch->data);
+    free(f.scratch);
   }
   f.open = 0;
   f.path = NULL;
@@ -65,90 +253,219 @@ void close_CELfile(CELfile f){
 }
 
 void reset_CELfile(CELfile f){
-  if(f.open == 1) rewind(f.handle);
+  if(f.open != 1) return;
+  if(f.backend == CEL_BACKEND_MMAP) f.map->pos = 0;
+  else f.prefix->pos = 0;
 }
 
-char readCEL_int8(int8_t *value, size_t n, CELfile f){
-  if(fread(value, sizeof(int8_t), n, f.handle) == n) return CEL_READ_VALUE_OK;
+char seek_CELfile(CELfile f, long offset){
+  if((f.open != 1) || (offset < 0)) return CEL_READ_VALUE_FAILED;
+  // Both backends accept offsets past the end of the file, leaving the next read to fail, so that truncation is
+  // only found by the reads that need the missing data (or by the structural checks):
+  if(f.backend == CEL_BACKEND_MMAP){
+    f.map->pos = offset;
+    return CEL_READ_VALUE_OK;
+  }
+  // The handle itself is only repositioned if a read goes past the prefix:
+  f.prefix->pos = offset;
+  return CEL_READ_VALUE_OK;
+}
+
+// Move the cursor forward past bytes that are not needed (reads past the end of the file still fail):
+char skip_CELfile(CELfile f, int64_t n){
+  long offset = tell_CELfile(f);
+  if((offset < 0) || (n < 0) || (n > LONG_MAX - offset)) return CEL_READ_VALUE_FAILED;
+  return seek_CELfile(f, offset + n);
+}
+
+long tell_CELfile(CELfile f){
+  if(f.open != 1) return -1;
+  if(f.backend == CEL_BACKEND_MMAP) return f.map->pos;
+  return f.prefix->pos;
+}
+
+long size_CELfile(CELfile f){
+  if(f.open != 1) return -1;
+  if(f.backend == CEL_BACKEND_MMAP) return f.map->size;
+  return size_CELstream(f.stream);
+}
+
+char is_CELfile_positional(CELfile f){
+  if(f.open != 1) return 0;
+  if(f.backend == CEL_BACKEND_MMAP) return 1;
+  // Handles with no descriptor behind them (such as fmemopen() buffers) cannot be read with pread():
+  return (f.stream->type == CEL_STREAM_FILE) && (fileno(f.handle) >= 0);
+}
+
+char is_CELfile_failed(CELfile f){
+  if(f.open != 1) return 1;
+  if(f.stream != NULL) return is_CELstream_failed(f.stream);
+  return 0;
+}
+
+char check_CELfile_extent(CELfile f, int64_t end){
+  long size = size_CELfile(f);
+  unsigned char last;
+  // The length of a decompressed stream is only known by reading it, so check the offset can be reached:
+  if((size < 0) && (f.stream != NULL) && (end > 0)){
+    if(seek_CELstream(f.stream, end - 1) != CEL_READ_VALUE_OK) return CEL_READ_VALUE_FAILED;
+    if(read_CELstream(f.stream, &last, 1) != 1) return CEL_READ_VALUE_FAILED;
+    return CEL_READ_VALUE_OK;
+  }
+  // Other files of unknown size cannot be checked, so are given the benefit of the doubt:
+  if(size < 0) return CEL_READ_VALUE_OK;
+  if((end < 0) || (end > size)) return CEL_READ_VALUE_FAILED;
+  return CEL_READ_VALUE_OK;
+}
+
+// Return a pointer to the next n mapped bytes, advancing the cursor past them:
+static unsigned char *map_CELfile_bytes(size_t n, CELfile f){
+  unsigned char *p;
+  if((f.map->pos > f.map->size) || (n > f.map->size - f.map->pos)) return NULL;
+  p = f.map->data + f.map->pos;
+  f.map->pos += n;
+  return p;
+}
+
+// Copy up to n bytes from the prefix at the current position, returning the number copied:
+static size_t prefix_CELfile_bytes(void *value, size_t n, CELfile f){
+  CELprefix *p = f.prefix;
+  if(p->pos >= (long)p->size) return 0;
+  if(n > p->size - p->pos) n = p->size - p->pos;
+  memcpy(value, p->data + p->pos, n);
+  p->pos += n;
+  return n;
+}
+
+// Read up to n bytes from the stream at the current position, seeking only if it was left elsewhere:
+static size_t stream_CELfile_bytes(void *value, size_t n, CELfile f){
+  CELprefix *p = f.prefix;
+  size_t result;
+  if(n == 0) return 0;
+  if((f.stream->pos != p->pos) && (seek_CELstream(f.stream, p->pos) != CEL_READ_VALUE_OK)) return 0;
+  result = read_CELstream(f.stream, value, n);
+  p->pos += result;
+  return result;
+}
+
+void *scratch_CELfile(size_t n, CELfile f){
+  void *data;
+  if(n <= f.scratch->size) return f.scratch->data;
+  // Grow the buffer geometrically so that repeated reads settle on a single allocation:
+  if(n < f.scratch->size * 2) n = f.scratch->size * 2;
+  if(n < CEL_SCRATCH_MIN_SIZE) n = CEL_SCRATCH_MIN_SIZE;
+  data = realloc(f.scratch->data, n);
+  if(data == NULL) return NULL;
+  f.scratch->data = data;
+  f.scratch->size = n;
+  return data;
+}
+
+char needs_CEL_byteswap(char bitflip){
+  if(check_endian() == MACHINE_BIG_ENDIAN) return (bitflip == 0);
+  return (bitflip != 0);
+}
+
+char readCEL_bytes(void *value, size_t n, CELfile f){
+  unsigned char *p;
+  size_t result;
+  if(f.backend == CEL_BACKEND_MMAP){
+    p = map_CELfile_bytes(n, f);
+    if(p == NULL) return CEL_READ_VALUE_FAILED;
+    memcpy(value, p, n);
+    return CEL_READ_VALUE_OK;
+  }
+  result = prefix_CELfile_bytes(value, n, f);
+  if(result < n) result += stream_CELfile_bytes((unsigned char*)value + result, n - result, f);
+  if(result == n) return CEL_READ_VALUE_OK;
   return CEL_READ_VALUE_FAILED;
 }
 
-char readCEL_int16(int16_t *value, size_t n, CELfile f, char bitflip){
-  unsigned char *buffer;
-  int i;
-  unsigned int a, b;
-  buffer = (unsigned char*)malloc(n * 2 * sizeof(unsigned char));
-  if(buffer == NULL) return CEL_READ_VALUE_FAILED;
-  if(fread(buffer, sizeof(char), n * 2, f.handle) != n * 2) return CEL_READ_VALUE_FAILED;
-  for(i=0; i<n; i++){
-    a = (unsigned int)buffer[0 + (i * 2)];
-    b = (unsigned int)buffer[1 + (i * 2)];
-    if(bitflip == 0) value[i] = a | (b << 8);
-    else value[i] = b | (a << 8);
-  }
-  free(buffer);
+size_t readCEL_block(void *buffer, size_t n, CELfile f){
+  size_t result;
+  if(f.backend == CEL_BACKEND_MMAP){
+    if(f.map->pos > f.map->size) return 0;
+    if(n > f.map->size - f.map->pos) n = f.map->size - f.map->pos;
+    memcpy(buffer, f.map->data + f.map->pos, n);
+    f.map->pos += n;
+    return n;
+  }
+  // Blocks may come up short at the end of the prefix; only a zero return marks the end of the file:
+  result = prefix_CELfile_bytes(buffer, n, f);
+  if(result > 0) return result;
+  return stream_CELfile_bytes(buffer, n, f);
+}
+
+size_t readCEL_at(void *buffer, size_t n, long offset, CELfile f){
+  size_t total = 0;
+  ssize_t result;
+  if((f.open != 1) || (offset < 0)) return 0;
+  if(f.backend == CEL_BACKEND_MMAP){
+    if(offset >= f.map->size) return 0;
+    if(n > f.map->size - offset) n = f.map->size - offset;
+    memcpy(buffer, f.map->data + offset, n);
+    return n;
+  }
+  // Positional reads leave the stream position alone, so they are safe from several threads:
+  if(offset < (long)f.prefix->size){
+    total = f.prefix->size - offset;
+    if(total > n) total = n;
+    memcpy(buffer, f.prefix->data + offset, total);
+  }
+  // Other streams can only be read in order, so have nothing positional past the prefix:
+  if(is_CELfile_positional(f) != 1) return total;
+  while(total < n){
+    result = pread(fileno(f.handle), (char*)buffer + total, n - total, offset + total);
+    count_CELprofile_read(result > 0 ? result : 0);
+    if(result < 0) __atomic_store_n(&f.stream->error, 1, __ATOMIC_RELAXED);
+    if(result <= 0) break;
+    total += result;
+  }
+  return total;
+}
+
+char readCEL_int8(int8_t *value, size_t n, CELfile f){
+  return readCEL_bytes(value, n * sizeof(int8_t), f);
+}
+
+// Read n packed values of the given width, reordering their bytes if needed. Mapped values are
+// decoded straight from the mapping; buffered values are read into the destination and reordered
+// in place:
+static char readCEL_packed(void *value, size_t n, size_t width, CELfile f, char bitflip){
+  unsigned char *p;
+  char swap = needs_CEL_byteswap(bitflip);
+  if(f.backend == CEL_BACKEND_MMAP){
+    p = map_CELfile_bytes(n * width, f);
+    if(p == NULL) return CEL_READ_VALUE_FAILED;
+  } else {
+    if(readCEL_bytes(value, n * width, f) != CEL_READ_VALUE_OK) return CEL_READ_VALUE_FAILED;
+    p = (unsigned char*)value;
+  }
+  if(swap == 0){
+    if(p != value) memcpy(value, p, n * width);
+  } else if(width == 2) swap_CEL_16(value, p, n);
+  else swap_CEL_32(value, p, n);
   return CEL_READ_VALUE_OK;
 }
 
+char readCEL_int16(int16_t *value, size_t n, CELfile f, char bitflip){
+  return readCEL_packed(value, n, 2, f, bitflip);
+}
+
 char readCEL_int32(int32_t *value, size_t n, CELfile f, char bitflip){
-  unsigned char *buffer;
-  int i;
-  unsigned int a, b, c, d;
-  buffer = (unsigned char*)malloc(n * 4 * sizeof(unsigned char));
-  
-  if(buffer == NULL) return CEL_READ_VALUE_FAILED;
-  if(fread(buffer, sizeof(char), n * 4, f.handle) != n * 4) return CEL_READ_VALUE_FAILED;
-  for(i=0; i<n; i++){
-    a = (unsigned int)buffer[0 + (i * 4)];
-    b = (unsigned int)buffer[1 + (i * 4)];
-    c = (unsigned int)buffer[2 + (i * 4)];
-    d = (unsigned int)buffer[3 + (i * 4)];
-    if(bitflip == 0) value[i] = a | (b << 8) | (c << 16) | (d << 24);
-    else value[i] = d | (c << 8) | (b << 16) | (a << 24);
-  }
-  free(buffer);
-  return CEL_READ_VALUE_OK;
+  return readCEL_packed(value, n, 4, f, bitflip);
 }
 
 char readCEL_uint8(u_int8_t *value, size_t n, CELfile f){
-  if(fread(value, sizeof(u_int8_t), n, f.handle) == n) return CEL_READ_VALUE_OK;
-  return CEL_READ_VALUE_FAILED;
+  return readCEL_bytes(value, n * sizeof(u_int8_t), f);
 }
 
 char readCEL_uint16(u_int16_t *value, size_t n, CELfile f, char bitflip){
-  unsigned char *buffer;
-  int i;
-  unsigned int a, b;
-  buffer = (unsigned char*)malloc(n * 2 * sizeof(unsigned char));
-  if(buffer == NULL) return CEL_READ_VALUE_FAILED;
-  if(fread(buffer, sizeof(char), n * 2, f.handle) != n * 2) return CEL_READ_VALUE_FAILED;
-  for(i=0; i<n; i++){
-    a = (unsigned int)buffer[0 + (i * 2)];
-    b = (unsigned int)buffer[1 + (i * 2)];
-    if(bitflip == 0) value[i] = a | (b << 8);
-    else value[i] = b | (a << 8);
-  }
-  free(buffer);
-  return CEL_READ_VALUE_OK;  
+  return readCEL_int16((int16_t *) value, n, f, bitflip);
 }
 
 char readCEL_uint32(u_int32_t *value, size_t n, CELfile f, char bitflip){
-  unsigned char *buffer;
-  int i;
-  unsigned int a, b, c, d;
-  buffer = (unsigned char*)malloc(n * 4 * sizeof(unsigned char));
-  if(buffer == NULL) return CEL_READ_VALUE_FAILED;
-  if(fread(buffer, sizeof(char), n * 4, f.handle) != n * 4) return CEL_READ_VALUE_FAILED;
-  for(i=0; i<n; i++){
-    a = (unsigned int)buffer[0 + (i * 4)];
-    b = (unsigned int)buffer[1 + (i * 4)];
-    c = (unsigned int)buffer[2 + (i * 4)];
-    d = (unsigned int)buffer[3 + (i * 4)];
-    if(bitflip == 0) value[i] = a | (b << 8) | (c << 16) | (d << 24);
-    else value[i] = d | (c << 8) | (b << 16) | (a << 24);
-  }
-  free(buffer);
-  return CEL_READ_VALUE_OK;
+  return readCEL_int32((int32_t *) value, n, f, bitflip);
 }
 
 char readCEL_float(float *value, size_t n, CELfile f, char bitflip){
@@ -158,15 +475,16 @@ char readCEL_float(float *value, size_t n, CELfile f, char bitflip){
 char readCEL_char(char **c, size_t n, CELfile f){
   *c = (char*)malloc((n + 1) * sizeof(char));
   if(*c == NULL) return CEL_READ_VALUE_FAILED;
-  memset(*c, 0, (n + 1) * sizeof(char));
-  fread(*c, sizeof(char), n, f.handle);
+  if(readCEL_bytes(*c, n, f) != CEL_READ_VALUE_OK) return CEL_READ_VALUE_FAILED;
   (*c)[n] = '\0';
   return CEL_READ_VALUE_OK;
 }
 
 char readCEL_str(char **s, CELfile f, char bitflip){
   int32_t string_length;
+  *s = NULL;
   if(readCEL_int32(&string_length, 1, f, bitflip) != CEL_READ_VALUE_OK) return CEL_READ_VALUE_FAILED;
+  if(string_length < 0) return CEL_READ_VALUE_FAILED;
   if(readCEL_char(s, string_length, f) == CEL_READ_VALUE_FAILED){
     free(*s);
     *s = NULL;
@@ -175,38 +493,72 @@ char readCEL_str(char **s, CELfile f, char bitflip){
   return CEL_READ_VALUE_OK;
 }
 
-char readCEL_wstr(char **s, CELfile f, char bitflip){
-  int32_t i, string_length;
-  char *buffer;
+char readCEL_str_scratch(char **s, CELfile f, char bitflip){
+  int32_t string_length;
+  *s = NULL;
   if(readCEL_int32(&string_length, 1, f, bitflip) != CEL_READ_VALUE_OK) return CEL_READ_VALUE_FAILED;
-  if(readCEL_char(&buffer, string_length * 2, f) == CEL_READ_VALUE_FAILED){
-    free(buffer);
-    buffer = NULL;
+  if(string_length < 0) return CEL_READ_VALUE_FAILED;
+  *s = (char*)scratch_CELfile(string_length + 1, f);
+  if(*s == NULL) return CEL_READ_VALUE_FAILED;
+  if(readCEL_bytes(*s, string_length, f) != CEL_READ_VALUE_OK){
+    *s = NULL;
     return CEL_READ_VALUE_FAILED;
   }
-  *s = (char*)malloc((string_length + 1) * sizeof(char));
-  if(*s == NULL){
-    free(buffer);
-    buffer = NULL;
-    return CEL_READ_VALUE_FAILED;    
+  (*s)[string_length] = '\0';
+  return CEL_READ_VALUE_OK;
+}
+
+char readCEL_wstr_scratch(char **s, CELfile f, char bitflip){
+  int32_t i, string_length;
+  char *buffer;
+  *s = NULL;
+  if(readCEL_int32(&string_length, 1, f, bitflip) != CEL_READ_VALUE_OK) return CEL_READ_VALUE_FAILED;
+  if(string_length < 0) return CEL_READ_VALUE_FAILED;
+  buffer = (char*)scratch_CELfile(((size_t)string_length * 2) + 1, f);
+  if(buffer == NULL) return CEL_READ_VALUE_FAILED;
+  // Wide strings are narrowed straight from the mapping when there is one:
+  if(f.backend == CEL_BACKEND_MMAP){
+    *s = (char*)map_CELfile_bytes((size_t)string_length * 2, f);
+    if(*s == NULL) return CEL_READ_VALUE_FAILED;
+  } else {
+    if(readCEL_bytes(buffer, (size_t)string_length * 2, f) != CEL_READ_VALUE_OK) return CEL_READ_VALUE_FAILED;
+    *s = buffer;
   }
-  memset(*s, 0, (string_length + 1) * sizeof(char));
-  for(i=0; i < string_length; i++)(*s)[i] = buffer[1 + (i * 2)];
-  free(buffer);
-  buffer = NULL;
+  // Each narrowed character is written no later than it is read, so this can work in place:
+  for(i=0; i < string_length; i++) buffer[i] = (*s)[1 + (i * 2)];
+  buffer[string_length] = '\0';
+  *s = buffer;
+  return CEL_READ_VALUE_OK;
+}
+
+char readCEL_wstr(char **s, CELfile f, char bitflip){
+  char *buffer;
+  size_t length;
+  *s = NULL;
+  if(readCEL_wstr_scratch(&buffer, f, bitflip) != CEL_READ_VALUE_OK) return CEL_READ_VALUE_FAILED;
+  length = strlen(buffer);
+  *s = (char*)malloc((length + 1) * sizeof(char));
+  if(*s == NULL) return CEL_READ_VALUE_FAILED;
+  memcpy(*s, buffer, length + 1);
   return CEL_READ_VALUE_OK;
 }
 
 char check_CELtype(CELfile f){
-  if(is_CELcalvin(f) == 1) return CEL_TYPE_CALVIN;
-  if(is_CELbinary(f) == 1) return CEL_TYPE_BINARY;
-  if(is_CELtext(f) == 1) return CEL_TYPE_TEXT;
+  u_int8_t first;
+  // The first byte is enough to pick the only format worth checking:
+  reset_CELfile(f);
+  if(readCEL_uint8(&first, 1, f) != CEL_READ_VALUE_OK) return CEL_TYPE_UNKNOWN;
+  if((first == 59) && (is_CELcalvin(f) == 1)) return CEL_TYPE_CALVIN;
+  if((first == 64) && (is_CELbinary(f) == 1)) return CEL_TYPE_BINARY;
+  if((first == '[') && (is_CELtext(f) == 1)) return CEL_TYPE_TEXT;
   return CEL_TYPE_UNKNOWN;
 }
 
 char readCEL(CELfile f, CELdata *d, char read_intensity, char verbose){
   char type;
+  enter_CELprofile(CEL_PROFILE_SNIFF);
   type = check_CELtype(f);
+  enter_CELprofile(CEL_PROFILE_HEADER);
   init_CELdata(d);
   if(type == CEL_TYPE_CALVIN) return readCELcalvin(f, d, read_intensity, verbose);
   if(type == CEL_TYPE_BINARY) return readCELbinary(f, d, read_intensity, verbose);
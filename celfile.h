@@ -32,19 +32,91 @@
 #define MACHINE_BIG_ENDIAN 1
 char check_endian();
 
+// Function to check whether values read with the given bitflip need their bytes reversing:
+char needs_CEL_byteswap(char bitflip);
+
+//Define the CELfile backends (the memory-mapped backend also reads buffers in place):
+#define CEL_BACKEND_STDIO 0
+#define CEL_BACKEND_MMAP 1
+
+// Define the struct to hold a file in memory (mapped, or a buffer borrowed from the caller) and its read cursor:
+typedef struct {
+  unsigned char *data;
+  size_t size;
+  size_t pos;
+  char mapped;
+} CELmap;
+
+// Define the struct to hold the first block of a buffered file and its logical read cursor:
+#define CEL_PREFIX_SIZE 65536
+typedef struct {
+  unsigned char *data;
+  size_t size;
+  long pos;
+} CELprefix;
+
+// Define the struct to hold a reusable scratch buffer:
+#define CEL_SCRATCH_MIN_SIZE 256
+typedef struct {
+  void *data;
+  size_t size;
+} CELscratch;
+
 // Define the struct to hold a CELfile connection:
 typedef struct {
   char open;
   char type;
+  char backend;
   char *path;
   char *name;
   FILE *handle;
+  CELstream *stream;
+  CELmap *map;
+  CELprefix *prefix;
+  CELscratch *scratch;
+  int threads;
+  char structural;
+  char fingerprint;
+  CELvisit visit;
+  void *visit_arg;
 } CELfile;
 
 // Functions to manipulate the CELfile connection:
 CELfile open_CELfile(char* path);
+CELfile open_CELfile_mapped(char* path);
+CELfile open_CELfile_stream(char *path, CELstream *stream);
+CELfile open_CELfile_handle(char *path, FILE *handle);
+CELfile open_CELfile_buffer(char *path, const void *data, size_t size);
+CELfile open_CELfile_prefix(char *path, int fd, unsigned char *data, size_t size);
 void close_CELfile(CELfile f);
+
+// Functions to ask the kernel to start reading a file ahead of opening it (the first length bytes, or all of it
+// if length is 0), and to drop it from the page cache once checked:
+void prefetch_CELfile(char *path, off_t length);
+void release_CELfile(char *path);
 void reset_CELfile(CELfile f);
+char seek_CELfile(CELfile f, long offset);
+char skip_CELfile(CELfile f, int64_t n);
+long tell_CELfile(CELfile f);
+long size_CELfile(CELfile f);
+
+// Function to check whether readCEL_at() can read anywhere in the file (and so from several threads):
+char is_CELfile_positional(CELfile f);
+
+// Function to check whether the file could not be opened, or a read from it failed (rather than finding it
+// too short or badly formed):
+char is_CELfile_failed(CELfile f);
+
+// Function to check that the file extends at least as far as the given offset:
+char check_CELfile_extent(CELfile f, int64_t end);
+
+// Function to borrow the CELfile's scratch buffer (valid until the next call):
+void *scratch_CELfile(size_t n, CELfile f);
+
+// Functions to read raw bytes from a CELfile:
+char readCEL_bytes(void *value, size_t n, CELfile f);
+size_t readCEL_block(void *buffer, size_t n, CELfile f);
+size_t readCEL_at(void *buffer, size_t n, long offset, CELfile f);
 
 // Functions to read signed integers from a CELfile:
 char readCEL_int8(int8_t *value, size_t n, CELfile f);
@@ -64,6 +136,10 @@ char readCEL_char(char **c, size_t n, CELfile f);
 char readCEL_str(char **s, CELfile f, char bitflip);
 char readCEL_wstr(char **s, CELfile f, char bitflip);
 
+// Functions to read strings into the CELfile's scratch buffer (valid until the next scratch read):
+char readCEL_str_scratch(char **s, CELfile f, char bitflip);
+char readCEL_wstr_scratch(char **s, CELfile f, char bitflip);
+
 // Function to test which type a file is:
 char check_CELtype(CELfile f);
 
@@ -0,0 +1,121 @@
+// checkcel - check the validity of an Affymetrix CEL file.
+// Copyright (C) 2016 Alastair Droop, The Leeds MRC Medical Bioinformatics Centre <a.p.droop@leeds.ac.uk>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include <unistd.h>
+#include "cel.h"
+#include "checkcel.h"
+
+// Define the struct behind the public handle:
+struct CELhandle {
+  CELfile file;
+  CELdata data;
+};
+
+// Wrap an opened file in a handle, closing it if it could not be opened:
+static CELhandle *create_CELhandle(CELfile f){
+  CELhandle *h;
+  if(f.open != 1){
+    close_CELfile(f);
+    return NULL;
+  }
+  h = (CELhandle*)malloc(sizeof(CELhandle));
+  if(h == NULL){
+    close_CELfile(f);
+    return NULL;
+  }
+  h->file = f;
+  init_CELdata(&h->data);
+  return h;
+}
+
+CELhandle *open_CELhandle_path(const char *path, int flags){
+  if(path == NULL) return NULL;
+  if((flags & CEL_OPEN_MEMORY_MAP) != 0) return create_CELhandle(open_CELfile_mapped((char*)path));
+  return create_CELhandle(open_CELfile((char*)path));
+}
+
+CELhandle *open_CELhandle_fd(int fd, const char *name){
+  FILE *handle;
+  int copy;
+  // Work on a copy of the descriptor, so that the caller's stays open:
+  copy = dup(fd);
+  if(copy < 0) return NULL;
+  handle = fdopen(copy, "r");
+  if(handle == NULL){
+    close(copy);
+    return NULL;
+  }
+  // Files are read from their start (pipes cannot be rewound, so are read from where they are):
+  fseek(handle, 0, SEEK_SET);
+  if(name == NULL) name = "(descriptor)";
+  return create_CELhandle(open_CELfile_handle((char*)name, handle));
+}
+
+CELhandle *open_CELhandle_buffer(const void *data, size_t size, const char *name){
+  if((data == NULL) && (size > 0)) return NULL;
+  if(name == NULL) name = "(buffer)";
+  return create_CELhandle(open_CELfile_buffer((char*)name, data, size));
+}
+
+void close_CELhandle(CELhandle *h){
+  if(h == NULL) return;
+  free_CELdata(&h->data);
+  close_CELfile(h->file);
+  free(h);
+}
+
+void set_CELhandle_threads(CELhandle *h, int threads){
+  if(threads < 1) threads = 1;
+  h->file.threads = threads;
+}
+
+char visit_CELhandle(CELhandle *h, int flags, CELhandle_visit visit, void *arg, CELsummary *s){
+  CELfile f = h->file;
+  // Each check starts again from the beginning of the file:
+  free_CELdata(&h->data);
+  f.structural = ((flags & CEL_CHECK_STRUCTURAL) != 0);
+  f.fingerprint = ((flags & CEL_CHECK_FINGERPRINT) != 0);
+  f.visit = visit;
+  f.visit_arg = arg;
+  if((visit != NULL) || (f.fingerprint == 1)) flags |= CEL_CHECK_INTENSITY;
+  readCEL(f, &h->data, (flags & CEL_CHECK_INTENSITY) != 0, 0);
+  if(s != NULL){
+    s->valid = h->data.valid;
+    s->type = h->data.type;
+    s->name = f.name;
+    s->array = h->data.array;
+    s->algorithm = h->data.algorithm;
+    s->rows = h->data.rows;
+    s->cols = h->data.cols;
+    s->cell_margin = h->data.cell_margin;
+    s->outliers = h->data.outliers;
+    s->masked = h->data.masked;
+    s->intensity_stats_calculated = h->data.intensity_stats_calculated;
+    s->intensity_min = h->data.intensity_min;
+    s->intensity_max = h->data.intensity_max;
+    s->intensity_n_unique = h->data.intensity_n_unique;
+    s->intensity_n_invalid = h->data.intensity_n_invalid;
+    s->intensity_hash_calculated = h->data.intensity_hash_calculated;
+    s->intensity_hash = h->data.intensity_hash;
+  }
+  if(h->data.valid != 1) return CEL_READ_VALUE_FAILED;
+  return CEL_READ_VALUE_OK;
+}
+
+char check_CELhandle(CELhandle *h, int flags, CELsummary *s){
+  return visit_CELhandle(h, flags, NULL, NULL, s);
+}
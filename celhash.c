@@ -0,0 +1,126 @@
+// checkcel - check the validity of an Affymetrix CEL file.
+// Copyright (C) 2016 Alastair Droop, The Leeds MRC Medical Bioinformatics Centre <a.p.droop@leeds.ac.uk>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include "cel.h"
+
+#define CEL_HASH_PRIME_1 0x9E3779B185EBCA87ULL
+#define CEL_HASH_PRIME_2 0xC2B2AE3D27D4EB4FULL
+#define CEL_HASH_PRIME_3 0x165667B19E3779F9ULL
+#define CEL_HASH_PRIME_4 0x85EBCA77C2B2AE63ULL
+#define CEL_HASH_PRIME_5 0x27D4EB2F165667C5ULL
+
+static inline u_int64_t rotate_CELhash(u_int64_t x, int r){
+  return (x << r) | (x >> (64 - r));
+}
+
+// Read little-endian words, so that every machine computes the same hash:
+static inline u_int64_t read_CELhash_64(const unsigned char *p){
+  return (u_int64_t)p[0] | ((u_int64_t)p[1] << 8) | ((u_int64_t)p[2] << 16) | ((u_int64_t)p[3] << 24) | ((u_int64_t)p[4] << 32) | ((u_int64_t)p[5] << 40) | ((u_int64_t)p[6] << 48) | ((u_int64_t)p[7] << 56);
+}
+
+static inline u_int64_t read_CELhash_32(const unsigned char *p){
+  return (u_int64_t)p[0] | ((u_int64_t)p[1] << 8) | ((u_int64_t)p[2] << 16) | ((u_int64_t)p[3] << 24);
+}
+
+static inline u_int64_t round_CELhash(u_int64_t accumulator, u_int64_t input){
+  accumulator += input * CEL_HASH_PRIME_2;
+  accumulator = rotate_CELhash(accumulator, 31);
+  return accumulator * CEL_HASH_PRIME_1;
+}
+
+static inline u_int64_t merge_CELhash(u_int64_t accumulator, u_int64_t value){
+  accumulator ^= round_CELhash(0, value);
+  return (accumulator * CEL_HASH_PRIME_1) + CEL_HASH_PRIME_4;
+}
+
+// Consume whole stripes, returning the number of bytes used:
+static size_t stripe_CELhash(CELhash *h, const unsigned char *p, size_t n){
+  size_t used = 0;
+  while(n - used >= CEL_HASH_STRIPE_SIZE){
+    h->v[0] = round_CELhash(h->v[0], read_CELhash_64(p + used));
+    h->v[1] = round_CELhash(h->v[1], read_CELhash_64(p + used + 8));
+    h->v[2] = round_CELhash(h->v[2], read_CELhash_64(p + used + 16));
+    h->v[3] = round_CELhash(h->v[3], read_CELhash_64(p + used + 24));
+    used += CEL_HASH_STRIPE_SIZE;
+  }
+  return used;
+}
+
+void init_CELhash(CELhash *h){
+  h->v[0] = CEL_HASH_PRIME_1 + CEL_HASH_PRIME_2;
+  h->v[1] = CEL_HASH_PRIME_2;
+  h->v[2] = 0;
+  h->v[3] = -CEL_HASH_PRIME_1;
+  h->total = 0;
+  h->buffered = 0;
+}
+
+void feed_CELhash(CELhash *h, const void *data, size_t n){
+  const unsigned char *p = (const unsigned char*)data;
+  size_t used;
+  h->total += n;
+  // Complete any partial stripe left by the previous call first:
+  if(h->buffered > 0){
+    used = CEL_HASH_STRIPE_SIZE - h->buffered;
+    if(used > n) used = n;
+    memcpy(h->buffer + h->buffered, p, used);
+    h->buffered += used;
+    p += used;
+    n -= used;
+    if(h->buffered < CEL_HASH_STRIPE_SIZE) return;
+    stripe_CELhash(h, h->buffer, CEL_HASH_STRIPE_SIZE);
+    h->buffered = 0;
+  }
+  used = stripe_CELhash(h, p, n);
+  memcpy(h->buffer, p + used, n - used);
+  h->buffered = n - used;
+}
+
+u_int64_t finish_CELhash(CELhash *h){
+  u_int64_t hash;
+  const unsigned char *p = h->buffer;
+  size_t n = h->buffered;
+  if(h->total >= CEL_HASH_STRIPE_SIZE){
+    hash = rotate_CELhash(h->v[0], 1) + rotate_CELhash(h->v[1], 7) + rotate_CELhash(h->v[2], 12) + rotate_CELhash(h->v[3], 18);
+    hash = merge_CELhash(hash, h->v[0]);
+    hash = merge_CELhash(hash, h->v[1]);
+    hash = merge_CELhash(hash, h->v[2]);
+    hash = merge_CELhash(hash, h->v[3]);
+  } else hash = CEL_HASH_PRIME_5;
+  hash += h->total;
+  for(; n >= 8; n -= 8, p += 8){
+    hash ^= round_CELhash(0, read_CELhash_64(p));
+    hash = (rotate_CELhash(hash, 27) * CEL_HASH_PRIME_1) + CEL_HASH_PRIME_4;
+  }
+  if(n >= 4){
+    hash ^= read_CELhash_32(p) * CEL_HASH_PRIME_1;
+    hash = (rotate_CELhash(hash, 23) * CEL_HASH_PRIME_2) + CEL_HASH_PRIME_3;
+    n -= 4;
+    p += 4;
+  }
+  for(; n > 0; n--, p++){
+    hash ^= (*p) * CEL_HASH_PRIME_5;
+    hash = rotate_CELhash(hash, 11) * CEL_HASH_PRIME_1;
+  }
+  // Mix the final bits:
+  hash ^= hash >> 33;
+  hash *= CEL_HASH_PRIME_2;
+  hash ^= hash >> 29;
+  hash *= CEL_HASH_PRIME_3;
+  hash ^= hash >> 32;
+  return hash;
+}
@@ -0,0 +1,36 @@
+// checkcel - check the validity of an Affymetrix CEL file.
+// Copyright (C) 2016 Alastair Droop, The Leeds MRC Medical Bioinformatics Centre <a.p.droop@leeds.ac.uk>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __checkcel_celhash_h
+#define __checkcel_celhash_h
+
+// Define the number of bytes consumed by each round of the hash:
+#define CEL_HASH_STRIPE_SIZE 32
+
+// Define the struct holding a running 64-bit content hash (XXH64, seed 0):
+typedef struct {
+  u_int64_t v[4];
+  u_int64_t total;
+  unsigned char buffer[CEL_HASH_STRIPE_SIZE];
+  size_t buffered;
+} CELhash;
+
+// Functions to hash data incrementally (the result depends only on the bytes fed, not how they are split):
+void init_CELhash(CELhash *h);
+void feed_CELhash(CELhash *h, const void *data, size_t n);
+u_int64_t finish_CELhash(CELhash *h);
+
+#endif
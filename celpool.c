@@ -0,0 +1,288 @@
+// checkcel - check the validity of an Affymetrix CEL file.
+// Copyright (C) 2016 Alastair Droop, The Leeds MRC Medical Bioinformatics Centre <a.p.droop@leeds.ac.uk>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <stdio.h>
+#include <unistd.h>
+#include "cel.h"
+
+// Check a job's file, using the descriptor and first block already read for it if there are any:
+static void check_CELjob(CELjob *job, CELcheck_options *o){
+  check_CELpath_prefix(job->path, job->fd, job->prefix, job->prefix_size, o, &job->result);
+  job->fd = -1;
+  job->prefix = NULL;
+}
+
+// Hand a job to the worker threads:
+static void queue_CELjob(CELpool *p, CELjob *job){
+  pthread_mutex_lock(&p->lock);
+  if(p->queue_tail == NULL) p->queue_head = job;
+  else p->queue_tail->next = job;
+  p->queue_tail = job;
+  pthread_cond_signal(&p->job_queued);
+  pthread_mutex_unlock(&p->lock);
+}
+
+static void *run_CELpool_worker(void *arg){
+  CELpool *p = (CELpool*)arg;
+  CELjob *job;
+  pthread_mutex_lock(&p->lock);
+  while(1){
+    while((p->queue_head == NULL) && (p->stopping == 0)) pthread_cond_wait(&p->job_queued, &p->lock);
+    if(p->queue_head == NULL) break;
+    // Take the next job from the queue:
+    job = p->queue_head;
+    p->queue_head = job->next;
+    if(p->queue_head == NULL) p->queue_tail = NULL;
+    pthread_mutex_unlock(&p->lock);
+    // Check the file without holding the lock:
+    check_CELjob(job, p->options);
+    pthread_mutex_lock(&p->lock);
+    job->done = 1;
+    pthread_cond_broadcast(&p->job_done);
+  }
+  pthread_mutex_unlock(&p->lock);
+  return NULL;
+}
+
+CELpool *create_CELpool(int thread_number, CELcheck_options *o){
+  CELpool *p;
+  int i;
+  p = (CELpool*)malloc(sizeof(CELpool));
+  if(p == NULL) return NULL;
+  p->thread_number = 0;
+  p->threads = NULL;
+  p->queue_head = NULL;
+  p->queue_tail = NULL;
+  p->stopping = 0;
+  p->options = o;
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->job_queued, NULL);
+  pthread_cond_init(&p->job_done, NULL);
+  if(thread_number < 1) return p;
+  p->threads = (pthread_t*)malloc(thread_number * sizeof(pthread_t));
+  if(p->threads == NULL){
+    free_CELpool(p);
+    return NULL;
+  }
+  // Start the worker threads:
+  for(i=0; i<thread_number; i++){
+    if(pthread_create(&p->threads[i], NULL, run_CELpool_worker, p) != 0) break;
+    p->thread_number++;
+  }
+  if(p->thread_number == 0){
+    free_CELpool(p);
+    return NULL;
+  }
+  return p;
+}
+
+void free_CELpool(CELpool *p){
+  int i;
+  if(p == NULL) return;
+  // Stop the worker threads once the queue is empty:
+  pthread_mutex_lock(&p->lock);
+  p->stopping = 1;
+  pthread_cond_broadcast(&p->job_queued);
+  pthread_mutex_unlock(&p->lock);
+  for(i=0; i<p->thread_number; i++) pthread_join(p->threads[i], NULL);
+  if(p->threads != NULL) free(p->threads);
+  p->threads = NULL;
+  pthread_cond_destroy(&p->job_done);
+  pthread_cond_destroy(&p->job_queued);
+  pthread_mutex_destroy(&p->lock);
+  free(p);
+}
+
+CELbatch *create_CELbatch(CELpool *p, FILE *stream){
+  CELbatch *b;
+  b = (CELbatch*)malloc(sizeof(CELbatch));
+  if(b == NULL) return NULL;
+  b->pool = p;
+  b->stream = stream;
+  b->window = 1;
+  if(p->thread_number > 0) b->window = p->thread_number * CEL_POOL_JOBS_PER_THREAD;
+  if(p->options->prefetch > 0) b->window += p->options->prefetch;
+  if(p->options->uring > 0) b->window += p->options->uring;
+  b->first = 0;
+  b->count = 0;
+  b->ring = NULL;
+  b->reading = 0;
+  b->jobs = (CELjob*)malloc(b->window * sizeof(CELjob));
+  if(b->jobs == NULL){
+    free(b);
+    return NULL;
+  }
+  // Memory-mapped files are read by the parsers themselves, and without a ring files are opened as usual:
+  if((p->options->uring > 0) && (p->options->memory_map == 0)) b->ring = create_CELuring(b->window);
+  return b;
+}
+
+// Stop using the batch's ring, reading the files still waiting for it through stdio. Each of those files has one
+// request outstanding, which is waited for first so that the kernel is done with its buffer (and so that files
+// it opened can be closed). If the ring fails while doing so, the buffers still in use are left allocated:
+static void drop_CELbatch_ring(CELbatch *b){
+  CELjob *job;
+  u_int64_t tag;
+  int result;
+  size_t i;
+  for(i=b->reading; i>0; i--){
+    if(wait_CELuring(b->ring, &tag, &result) != CEL_READ_VALUE_OK) break;
+    job = &b->jobs[tag];
+    if((job->reading == CEL_JOB_OPENING) && (result >= 0)) close(result);
+    if(job->fd >= 0) close(job->fd);
+    if(job->prefix != NULL) free(job->prefix);
+    job->fd = -1;
+    job->prefix = NULL;
+    job->reading = CEL_JOB_READY;
+    if(b->pool->thread_number > 0) queue_CELjob(b->pool, job);
+  }
+  free_CELuring(b->ring);
+  b->ring = NULL;
+  for(i=0; i<b->count; i++){
+    job = &b->jobs[(b->first + i) % b->window];
+    if(job->reading == CEL_JOB_READY) continue;
+    // The kernel keeps its own reference to a file being read, so only the buffer must be kept:
+    if(job->fd >= 0) close(job->fd);
+    job->fd = -1;
+    job->prefix = NULL;
+    job->reading = CEL_JOB_READY;
+    if(b->pool->thread_number > 0) queue_CELjob(b->pool, job);
+  }
+  b->reading = 0;
+}
+
+// Wait for the next io_uring completion, and move its job on to reading its first block or being checked:
+static void pump_CELbatch(CELbatch *b){
+  CELjob *job;
+  u_int64_t tag;
+  int result;
+  if(wait_CELuring(b->ring, &tag, &result) != CEL_READ_VALUE_OK){
+    drop_CELbatch_ring(b);
+    return;
+  }
+  job = &b->jobs[tag];
+  if(job->reading == CEL_JOB_OPENING){
+    if(result >= 0){
+      job->fd = result;
+      job->prefix = (unsigned char*)malloc(CEL_PREFIX_SIZE);
+      if((job->prefix != NULL) && (queue_CELuring_read(b->ring, job->fd, job->prefix, CEL_PREFIX_SIZE, tag) == CEL_READ_VALUE_OK)){
+        job->reading = CEL_JOB_READING;
+        submit_CELuring(b->ring);
+        return;
+      }
+      if(job->prefix != NULL) free(job->prefix);
+      job->prefix = NULL;
+      close(job->fd);
+      job->fd = -1;
+    }
+  } else if(result >= 0) job->prefix_size = result;
+  else {
+    close(job->fd);
+    free(job->prefix);
+    job->fd = -1;
+    job->prefix = NULL;
+  }
+  // Files that could not be opened or read are tried again through stdio (and reported as usual if they fail):
+  job->reading = CEL_JOB_READY;
+  b->reading--;
+  if(b->pool->thread_number > 0) queue_CELjob(b->pool, job);
+}
+
+// Wait for the oldest job in the batch to finish, write it out and release it:
+static void finish_CELbatch_job(CELbatch *b){
+  CELjob *job = &b->jobs[b->first];
+  CELpool *p = b->pool;
+  if(p->thread_number > 0){
+    pthread_mutex_lock(&p->lock);
+    while(job->done == 0){
+      // Keep the ring moving while waiting, so that the workers are not left without files:
+      if(b->reading > 0){
+        pthread_mutex_unlock(&p->lock);
+        pump_CELbatch(b);
+        pthread_mutex_lock(&p->lock);
+        continue;
+      }
+      pthread_cond_wait(&p->job_done, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+  } else {
+    while(job->reading != CEL_JOB_READY) pump_CELbatch(b);
+    check_CELjob(job, p->options);
+  }
+  print_CELresult(b->stream, &job->result, p->options);
+  free_CELresult(&job->result);
+  // Prefetched files are not needed again, so should not push other data out of the page cache:
+  if(job->prefetched == 1) release_CELfile(job->path);
+  free(job->path);
+  job->path = NULL;
+  b->first = (b->first + 1) % b->window;
+  b->count--;
+}
+
+char submit_CELbatch(CELbatch *b, char *path){
+  CELjob *job;
+  CELpool *p = b->pool;
+  // Make room in the window by writing out the oldest job:
+  while(b->count >= b->window) finish_CELbatch_job(b);
+  job = &b->jobs[(b->first + b->count) % b->window];
+  job->path = (char*)malloc((strlen(path) + 1) * sizeof(char));
+  if(job->path == NULL) return 1;
+  strcpy(job->path, path);
+  job->done = 0;
+  job->next = NULL;
+  job->reading = CEL_JOB_READY;
+  job->fd = -1;
+  job->prefix = NULL;
+  job->prefix_size = 0;
+  job->prefetched = 0;
+  init_CELresult(&job->result);
+  b->count++;
+  // Files answered from the cache are not read, so are neither prefetched nor opened through the ring:
+  if(((p->options->prefetch > 0) || (b->ring != NULL)) && (is_CELpath_cached(job->path, p->options) == 1)){
+    if(p->thread_number > 0) queue_CELjob(p, job);
+    return 0;
+  }
+  // Start reading the file while the jobs ahead of it are checked (all of it if the intensities are needed):
+  if(p->options->prefetch > 0){
+    if((p->options->read_intensity == 1) || (p->options->fingerprint == 1)) prefetch_CELfile(job->path, 0);
+    else prefetch_CELfile(job->path, CEL_POOL_PREFETCH_HEADER_SIZE);
+    job->prefetched = 1;
+  }
+  // Queue the file's open on the ring (the job is handed on once its first block has been read):
+  if((b->ring != NULL) && (queue_CELuring_open(b->ring, job->path, job - b->jobs) == CEL_READ_VALUE_OK)){
+    job->reading = CEL_JOB_OPENING;
+    b->reading++;
+    // Start the open now, rather than when the window fills and the batch waits on the ring:
+    submit_CELuring(b->ring);
+    return 0;
+  }
+  if(p->thread_number > 0) queue_CELjob(p, job);
+  return 0;
+}
+
+void flush_CELbatch(CELbatch *b){
+  while(b->count > 0) finish_CELbatch_job(b);
+  fflush(b->stream);
+}
+
+void free_CELbatch(CELbatch *b){
+  if(b == NULL) return;
+  flush_CELbatch(b);
+  free_CELuring(b->ring);
+  free(b->jobs);
+  free(b);
+}
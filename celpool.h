@@ -0,0 +1,82 @@
+// checkcel - check the validity of an Affymetrix CEL file.
+// Copyright (C) 2016 Alastair Droop, The Leeds MRC Medical Bioinformatics Centre <a.p.droop@leeds.ac.uk>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __checkcel_celpool_h
+#define __checkcel_celpool_h
+
+// Define the number of jobs each worker thread may have in flight:
+#define CEL_POOL_JOBS_PER_THREAD 4
+
+// Define how much of each file is prefetched when only the headers are read:
+#define CEL_POOL_PREFETCH_HEADER_SIZE 262144
+
+// Define the states of a job's io_uring reads:
+#define CEL_JOB_READY 0
+#define CEL_JOB_OPENING 1
+#define CEL_JOB_READING 2
+
+// Define the struct holding a single queued file check (with the descriptor and first block read through
+// io_uring, if it was used, and whether the file was prefetched):
+typedef struct CELjob {
+  char *path;
+  char done;
+  char reading;
+  char prefetched;
+  int fd;
+  unsigned char *prefix;
+  size_t prefix_size;
+  CELresult result;
+  struct CELjob *next;
+} CELjob;
+
+// Define the struct holding the worker threads:
+typedef struct {
+  int thread_number;
+  pthread_t *threads;
+  pthread_mutex_t lock;
+  pthread_cond_t job_queued;
+  pthread_cond_t job_done;
+  CELjob *queue_head;
+  CELjob *queue_tail;
+  char stopping;
+  CELcheck_options *options;
+} CELpool;
+
+// Define the struct holding an ordered sequence of jobs written to a single stream (with prefetching, the window
+// also holds the files whose reads have been started ahead of checking them):
+typedef struct {
+  CELpool *pool;
+  FILE *stream;
+  CELjob *jobs;
+  size_t window;
+  size_t first;
+  size_t count;
+  CELuring *ring;
+  size_t reading;
+} CELbatch;
+
+// Functions to manipulate the worker pool (a pool with no threads checks files inline):
+CELpool *create_CELpool(int thread_number, CELcheck_options *o);
+void free_CELpool(CELpool *p);
+
+// Functions to check files in order through a pool (with io_uring, files are opened and their first blocks read
+// while they wait in the window, and are only handed to the workers once read):
+CELbatch *create_CELbatch(CELpool *p, FILE *stream);
+char submit_CELbatch(CELbatch *b, char *path);
+void flush_CELbatch(CELbatch *b);
+void free_CELbatch(CELbatch *b);
+
+#endif
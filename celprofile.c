@@ -0,0 +1,168 @@
+// checkcel - check the validity of an Affymetrix CEL file.
+// Copyright (C) 2016 Alastair Droop, The Leeds MRC Medical Bioinformatics Centre <a.p.droop@leeds.ac.uk>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include <time.h>
+#include "cel.h"
+
+// The profile being recorded on each thread:
+static __thread CELprofile *CELprofile_current = NULL;
+
+static double now_CELprofile(){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+void init_CELprofile(CELprofile *p){
+  int i;
+  p->phase = CEL_PROFILE_OPEN;
+  p->phase_start = 0;
+  for(i=0; i<CEL_PROFILE_PHASES; i++) p->seconds[i] = 0;
+  p->bytes = 0;
+  p->reads = 0;
+  p->seeks = 0;
+  p->allocations = 0;
+}
+
+void start_CELprofile(CELprofile *p){
+  p->phase = CEL_PROFILE_OPEN;
+  p->phase_start = now_CELprofile();
+  CELprofile_current = p;
+}
+
+void stop_CELprofile(){
+  CELprofile *p = CELprofile_current;
+  if(p == NULL) return;
+  p->seconds[(int)p->phase] += now_CELprofile() - p->phase_start;
+  CELprofile_current = NULL;
+}
+
+void enter_CELprofile(char phase){
+  CELprofile *p = CELprofile_current;
+  double now;
+  if((p == NULL) || (p->phase == phase)) return;
+  now = now_CELprofile();
+  p->seconds[(int)p->phase] += now - p->phase_start;
+  p->phase = phase;
+  p->phase_start = now;
+}
+
+void count_CELprofile_read(size_t bytes){
+  CELprofile *p = CELprofile_current;
+  if(p == NULL) return;
+  p->reads++;
+  p->bytes += bytes;
+}
+
+void count_CELprofile_seek(){
+  CELprofile *p = CELprofile_current;
+  if(p != NULL) p->seeks++;
+}
+
+void count_CELprofile_allocation(){
+  CELprofile *p = CELprofile_current;
+  if(p != NULL) p->allocations++;
+}
+
+double total_CELprofile(CELprofile *p){
+  double total = 0;
+  int i;
+  for(i=0; i<CEL_PROFILE_PHASES; i++) total += p->seconds[i];
+  return total;
+}
+
+void fprint_CELprofile(FILE *stream, CELprofile *p){
+  int i;
+  for(i=0; i<CEL_PROFILE_PHASES; i++) fprintf(stream, "\t%0.3f", p->seconds[i] * 1000);
+  fprintf(stream, "\t%llu\t%llu\t%llu\t%llu", (unsigned long long)p->bytes, (unsigned long long)p->reads, (unsigned long long)p->seeks, (unsigned long long)p->allocations);
+}
+
+CELprofiles *create_CELprofiles(){
+  CELprofiles *s;
+  int i;
+  s = (CELprofiles*)malloc(sizeof(CELprofiles));
+  if(s == NULL) return NULL;
+  for(i=0; i<CEL_PROFILE_FORMATS; i++){
+    s->formats[i].n = 0;
+    s->formats[i].size = 0;
+    s->formats[i].totals = NULL;
+    init_CELprofile(&s->formats[i].sum);
+  }
+  return s;
+}
+
+void add_CELprofiles(CELprofiles *s, char type, CELprofile *p){
+  CELprofile_format *format;
+  double *totals;
+  size_t size;
+  int i;
+  if((type < CEL_TYPE_UNKNOWN) || (type >= CEL_TYPE_UNKNOWN + CEL_PROFILE_FORMATS)) type = CEL_TYPE_UNKNOWN;
+  format = &s->formats[type - CEL_TYPE_UNKNOWN];
+  // Keep each file's total time for the percentiles:
+  if(format->n == format->size){
+    size = format->size * 2;
+    if(size < 256) size = 256;
+    totals = (double*)realloc(format->totals, size * sizeof(double));
+    if(totals == NULL) return;
+    format->totals = totals;
+    format->size = size;
+  }
+  format->totals[format->n++] = total_CELprofile(p);
+  for(i=0; i<CEL_PROFILE_PHASES; i++) format->sum.seconds[i] += p->seconds[i];
+  format->sum.bytes += p->bytes;
+  format->sum.reads += p->reads;
+  format->sum.seeks += p->seeks;
+  format->sum.allocations += p->allocations;
+}
+
+static int compare_CELprofile_totals(const void *a, const void *b){
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+// Find a percentile of a sorted list by the nearest-rank method:
+static double percentile_CELprofiles(double *totals, size_t n, int percent){
+  size_t rank = (n * percent + 99) / 100;
+  if(rank < 1) rank = 1;
+  return totals[rank - 1];
+}
+
+void print_CELprofiles(FILE *stream, CELprofiles *s){
+  static const char *names[CEL_PROFILE_FORMATS] = {"unknown", "binary", "calvin", "text"};
+  CELprofile_format *format;
+  int i, j;
+  fprintf(stream, "format\tfiles\topen_ms\tsniff_ms\theader_ms\tpayload_ms\tstats_ms\ttotal_ms\tp50_ms\tp95_ms\tp99_ms\tbytes\treads\tseeks\tallocations\n");
+  for(i=0; i<CEL_PROFILE_FORMATS; i++){
+    format = &s->formats[i];
+    if(format->n == 0) continue;
+    qsort(format->totals, format->n, sizeof(double), compare_CELprofile_totals);
+    fprintf(stream, "%s\t%lu", names[i], (unsigned long)format->n);
+    for(j=0; j<CEL_PROFILE_PHASES; j++) fprintf(stream, "\t%0.3f", format->sum.seconds[j] * 1000);
+    fprintf(stream, "\t%0.3f", total_CELprofile(&format->sum) * 1000);
+    fprintf(stream, "\t%0.3f", percentile_CELprofiles(format->totals, format->n, 50) * 1000);
+    fprintf(stream, "\t%0.3f", percentile_CELprofiles(format->totals, format->n, 95) * 1000);
+    fprintf(stream, "\t%0.3f", percentile_CELprofiles(format->totals, format->n, 99) * 1000);
+    fprintf(stream, "\t%llu\t%llu\t%llu\t%llu\n", (unsigned long long)format->sum.bytes, (unsigned long long)format->sum.reads, (unsigned long long)format->sum.seeks, (unsigned long long)format->sum.allocations);
+  }
+}
+
+void free_CELprofiles(CELprofiles *s){
+  int i;
+  if(s == NULL) return;
+  for(i=0; i<CEL_PROFILE_FORMATS; i++) free(s->formats[i].totals);
+  free(s);
+}
@@ -0,0 +1,74 @@
+// checkcel - check the validity of an Affymetrix CEL file.
+// Copyright (C) 2016 Alastair Droop, The Leeds MRC Medical Bioinformatics Centre <a.p.droop@leeds.ac.uk>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __checkcel_celprofile_h
+#define __checkcel_celprofile_h
+
+// Define the phases that the time spent checking a file is divided between:
+#define CEL_PROFILE_OPEN 0
+#define CEL_PROFILE_SNIFF 1
+#define CEL_PROFILE_HEADER 2
+#define CEL_PROFILE_PAYLOAD 3
+#define CEL_PROFILE_STATS 4
+#define CEL_PROFILE_PHASES 5
+
+// Define the number of file formats summarised separately (unknown, binary, Calvin and text):
+#define CEL_PROFILE_FORMATS 4
+
+// Define the struct holding the profile of checking a single file:
+typedef struct {
+  char phase;
+  double phase_start;
+  double seconds[CEL_PROFILE_PHASES];
+  u_int64_t bytes;
+  u_int64_t reads;
+  u_int64_t seeks;
+  u_int64_t allocations;
+} CELprofile;
+
+// Functions to profile the checks made on the calling thread (phases and counts are only recorded between
+// start_CELprofile() and stop_CELprofile(), and only on that thread):
+void init_CELprofile(CELprofile *p);
+void start_CELprofile(CELprofile *p);
+void stop_CELprofile();
+void enter_CELprofile(char phase);
+void count_CELprofile_read(size_t bytes);
+void count_CELprofile_seek();
+void count_CELprofile_allocation();
+double total_CELprofile(CELprofile *p);
+
+// Write a profile as extra output columns:
+void fprint_CELprofile(FILE *stream, CELprofile *p);
+
+// Define the struct collecting the profiles of one file format for the summary:
+typedef struct {
+  size_t n;
+  size_t size;
+  double *totals;
+  CELprofile sum;
+} CELprofile_format;
+
+typedef struct {
+  CELprofile_format formats[CEL_PROFILE_FORMATS];
+} CELprofiles;
+
+// Functions to collect profiles, and write a summary of each format:
+CELprofiles *create_CELprofiles();
+void add_CELprofiles(CELprofiles *s, char type, CELprofile *p);
+void print_CELprofiles(FILE *stream, CELprofiles *s);
+void free_CELprofiles(CELprofiles *s);
+
+#endif
@@ -0,0 +1,195 @@
+// checkcel - check the validity of an Affymetrix CEL file.
+// Copyright (C) 2016 Alastair Droop, The Leeds MRC Medical Bioinformatics Centre <a.p.droop@leeds.ac.uk>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "cel.h"
+
+// Set by the signal handler to stop the server:
+static volatile sig_atomic_t CELserve_stopping = 0;
+
+static void stop_CELserver(int signal_number){
+  CELserve_stopping = 1;
+}
+
+// Remove a socket left at the path, returning 0 if the path is now free. Anything other than a socket is
+// left alone, so that a mistyped path cannot delete a file:
+static int remove_CELsocket(char *path){
+  struct stat info;
+  if(lstat(path, &info) != 0) return (errno == ENOENT) ? 0 : 1;
+  if(!S_ISSOCK(info.st_mode)) return 1;
+  return unlink(path);
+}
+
+// Remove a finished connection from the server, waking the server if it is waiting for it:
+static void remove_CELconnection(CELconnection *c){
+  CELserver *s = c->server;
+  CELconnection **link;
+  pthread_mutex_lock(&s->lock);
+  for(link = &s->connections; *link != NULL; link = &(*link)->next){
+    if(*link == c){
+      *link = c->next;
+      break;
+    }
+  }
+  pthread_cond_signal(&s->connection_closed);
+  pthread_mutex_unlock(&s->lock);
+}
+
+// Read paths from a client one per line, writing each batch's results (in order) once it ends with an
+// empty line or the end of the connection, followed by an empty line:
+static void *run_CELconnection(void *arg){
+  CELconnection *c = (CELconnection*)arg;
+  FILE *input = NULL, *output = NULL;
+  CELbatch *batch = NULL;
+  char *line = NULL;
+  size_t size = 0;
+  ssize_t length;
+  char pending = 0;
+  int copy;
+  copy = dup(c->fd);
+  if(copy >= 0){
+    input = fdopen(copy, "r");
+    if(input == NULL) close(copy);
+  }
+  if(input != NULL) output = fdopen(c->fd, "w");
+  if(output != NULL) batch = create_CELbatch(c->server->pool, output);
+  if(batch != NULL){
+    while((length = getline(&line, &size, input)) >= 0){
+      while((length > 0) && ((line[length - 1] == '\n') || (line[length - 1] == '\r'))) line[--length] = '\0';
+      if(length > 0){
+        // A path that cannot be queued (for want of memory) is answered, in its place, with an error line:
+        if(submit_CELbatch(batch, line) != 0){
+          flush_CELbatch(batch);
+          fprintf(output, "%s\terror\n", line);
+        }
+        pending = 1;
+        continue;
+      }
+      flush_CELbatch(batch);
+      fputc('\n', output);
+      fflush(output);
+      pending = 0;
+    }
+    if(pending == 1){
+      flush_CELbatch(batch);
+      fputc('\n', output);
+    }
+    free_CELbatch(batch);
+  }
+  free(line);
+  // Leave the server before the descriptor is closed, so that it is never shut down after reuse:
+  remove_CELconnection(c);
+  if(input != NULL) fclose(input);
+  if(output != NULL) fclose(output);
+  else close(c->fd);
+  free(c);
+  return NULL;
+}
+
+// Accept a client, checking its requests on a new thread:
+static void accept_CELconnection(CELserver *s){
+  CELconnection *c;
+  int fd;
+  fd = accept(s->fd, NULL, NULL);
+  if(fd < 0) return;
+  c = (CELconnection*)malloc(sizeof(CELconnection));
+  if(c == NULL){
+    close(fd);
+    return;
+  }
+  c->fd = fd;
+  c->server = s;
+  pthread_mutex_lock(&s->lock);
+  if(pthread_create(&c->thread, NULL, run_CELconnection, c) != 0){
+    pthread_mutex_unlock(&s->lock);
+    close(fd);
+    free(c);
+    return;
+  }
+  pthread_detach(c->thread);
+  c->next = s->connections;
+  s->connections = c;
+  pthread_mutex_unlock(&s->lock);
+}
+
+int serve_CELsocket(char *path, int thread_number, CELcheck_options *o){
+  CELserver s;
+  CELconnection *c;
+  struct sockaddr_un address;
+  struct sigaction action;
+  sigset_t blocked, waiting;
+  fd_set ready;
+  if(strlen(path) >= sizeof(address.sun_path)) return 1;
+  // Only the listening thread handles the stop signals, and then only while it is waiting:
+  sigemptyset(&blocked);
+  sigaddset(&blocked, SIGINT);
+  sigaddset(&blocked, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &blocked, &waiting);
+  sigdelset(&waiting, SIGINT);
+  sigdelset(&waiting, SIGTERM);
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = stop_CELserver;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  // Clients that hang up early must not stop the server:
+  signal(SIGPIPE, SIG_IGN);
+  // Start the worker threads (a single job is checked on each connection's thread):
+  s.pool = create_CELpool((thread_number > 1) ? thread_number : 0, o);
+  if(s.pool == NULL) return 1;
+  s.connections = NULL;
+  pthread_mutex_init(&s.lock, NULL);
+  pthread_cond_init(&s.connection_closed, NULL);
+  // Listen on the socket, replacing any socket left behind by an earlier server. Only its owner may connect,
+  // whatever the umask (no client can connect before listen(), so there is no window to close):
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, path);
+  s.fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(s.fd >= 0){
+    if((remove_CELsocket(path) != 0) || (bind(s.fd, (struct sockaddr*)&address, sizeof(address)) != 0) || (chmod(path, S_IRUSR | S_IWUSR) != 0) || (listen(s.fd, CEL_SERVE_BACKLOG) != 0)){
+      close(s.fd);
+      s.fd = -1;
+    }
+  }
+  while((s.fd >= 0) && (CELserve_stopping == 0)){
+    FD_ZERO(&ready);
+    FD_SET(s.fd, &ready);
+    if(pselect(s.fd + 1, &ready, NULL, NULL, NULL, &waiting) > 0) accept_CELconnection(&s);
+    else if(errno != EINTR) break;
+  }
+  if(s.fd >= 0){
+    close(s.fd);
+    remove_CELsocket(path);
+  }
+  // Stop reading from the clients, and wait for the requests in progress to finish:
+  pthread_mutex_lock(&s.lock);
+  for(c = s.connections; c != NULL; c = c->next) shutdown(c->fd, SHUT_RD);
+  while(s.connections != NULL) pthread_cond_wait(&s.connection_closed, &s.lock);
+  pthread_mutex_unlock(&s.lock);
+  free_CELpool(s.pool);
+  pthread_cond_destroy(&s.connection_closed);
+  pthread_mutex_destroy(&s.lock);
+  if(CELserve_stopping == 0) return 1;
+  return 0;
+}
@@ -0,0 +1,43 @@
+// checkcel - check the validity of an Affymetrix CEL file.
+// Copyright (C) 2016 Alastair Droop, The Leeds MRC Medical Bioinformatics Centre <a.p.droop@leeds.ac.uk>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __checkcel_celserve_h
+#define __checkcel_celserve_h
+
+// Define the number of connections waiting to be accepted:
+#define CEL_SERVE_BACKLOG 64
+
+// Define the struct holding a single client connection:
+typedef struct CELconnection {
+  int fd;
+  pthread_t thread;
+  struct CELserver *server;
+  struct CELconnection *next;
+} CELconnection;
+
+// Define the struct holding a listening server and its open connections:
+typedef struct CELserver {
+  int fd;
+  CELpool *pool;
+  pthread_mutex_t lock;
+  pthread_cond_t connection_closed;
+  CELconnection *connections;
+} CELserver;
+
+// Check batches of paths sent over a Unix domain socket until interrupted (returns 0 on a clean stop):
+int serve_CELsocket(char *path, int thread_number, CELcheck_options *o);
+
+#endif
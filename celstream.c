@@ -0,0 +1,464 @@
+// checkcel - check the validity of an Affymetrix CEL file.
+// Copyright (C) 2016 Alastair Droop, The Leeds MRC Medical Bioinformatics Centre <a.p.droop@leeds.ac.uk>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include "cel.h"
+#ifdef CEL_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef CEL_HAVE_BZIP2
+#include <bzlib.h>
+#endif
+#ifdef CEL_HAVE_LZMA
+#include <lzma.h>
+#endif
+
+// The decompressors count their output in 32-bit values, so larger reads are split:
+#define CEL_STREAM_READ_MAX 1073741824
+
+// Define the state of a window onto part of another stream. The window does not own the stream it
+// looks onto, so several windows can be opened in turn over one archive:
+typedef struct {
+  CELstream *source;
+  long start;
+  long size;
+  long pos;
+} CELstream_window;
+
+// Define the state of a stream that replays a block already read from the start of another stream before
+// carrying on from the source. Like a window, it does not own its source:
+typedef struct {
+  CELstream *source;
+  const unsigned char *data;
+  size_t size;
+  long pos;
+} CELstream_prefix;
+
+char sniff_CELstream(const unsigned char *data, size_t n){
+#ifdef CEL_HAVE_ZLIB
+  if((n >= 2) && (data[0] == 0x1f) && (data[1] == 0x8b)) return CEL_STREAM_GZIP;
+#endif
+#ifdef CEL_HAVE_BZIP2
+  if((n >= 3) && (memcmp(data, "BZh", 3) == 0)) return CEL_STREAM_BZIP2;
+#endif
+#ifdef CEL_HAVE_LZMA
+  if((n >= 6) && (memcmp(data, "\xfd" "7zXZ\0", 6) == 0)) return CEL_STREAM_XZ;
+#endif
+  return CEL_STREAM_FILE;
+}
+
+// Allocate a stream of the given type, with no source and nothing read:
+static CELstream *new_CELstream(char type){
+  CELstream *s;
+  s = (CELstream*)malloc(sizeof(CELstream));
+  if(s == NULL) return NULL;
+  s->type = type;
+  s->end = 0;
+  s->error = 0;
+  s->input_end = 0;
+  s->pos = 0;
+  s->handle = NULL;
+  s->source = NULL;
+  s->state = NULL;
+  s->input = NULL;
+  s->peek_start = 0;
+  s->peek_end = 0;
+  s->read = NULL;
+  s->seek = NULL;
+  s->start = NULL;
+  s->stop = NULL;
+  return s;
+}
+
+#if defined(CEL_HAVE_ZLIB) || defined(CEL_HAVE_BZIP2) || defined(CEL_HAVE_LZMA)
+// Read the next block of compressed input from the source stream:
+static size_t fill_CELstream_input(CELstream *s){
+  return read_CELstream(s->source, s->input, CEL_STREAM_INPUT_SIZE);
+}
+#endif
+
+static size_t read_CELstream_file(CELstream *s, void *buffer, size_t n){
+  n = fread(buffer, sizeof(char), n, s->handle);
+  count_CELprofile_read(n);
+  if(ferror(s->handle)) s->error = 1;
+  return n;
+}
+
+static char seek_CELstream_file(CELstream *s, long offset){
+  count_CELprofile_seek();
+  if(fseek(s->handle, offset, SEEK_SET) != 0) return CEL_READ_VALUE_FAILED;
+  return CEL_READ_VALUE_OK;
+}
+
+static size_t read_CELstream_window(CELstream *s, void *buffer, size_t n){
+  CELstream_window *w = (CELstream_window*)s->state;
+  if(n > w->size - w->pos) n = w->size - w->pos;
+  if(n == 0) return 0;
+  if(seek_CELstream(w->source, w->start + w->pos) != CEL_READ_VALUE_OK) return 0;
+  n = read_CELstream(w->source, buffer, n);
+  w->pos += n;
+  return n;
+}
+
+// Window seeks only move the window's cursor; the source is positioned by the next read:
+static char seek_CELstream_window(CELstream *s, long offset){
+  CELstream_window *w = (CELstream_window*)s->state;
+  if(offset > w->size) return CEL_READ_VALUE_FAILED;
+  w->pos = offset;
+  return CEL_READ_VALUE_OK;
+}
+
+// Bytes inside the block are copied from it; the source is only positioned once a read goes past it:
+static size_t read_CELstream_prefix(CELstream *s, void *buffer, size_t n){
+  CELstream_prefix *p = (CELstream_prefix*)s->state;
+  if(p->pos < (long)p->size){
+    if(n > p->size - p->pos) n = p->size - p->pos;
+    memcpy(buffer, p->data + p->pos, n);
+  } else {
+    if(seek_CELstream(p->source, p->pos) != CEL_READ_VALUE_OK) return 0;
+    n = read_CELstream(p->source, buffer, n);
+  }
+  p->pos += n;
+  return n;
+}
+
+static char seek_CELstream_prefix(CELstream *s, long offset){
+  ((CELstream_prefix*)s->state)->pos = offset;
+  return CEL_READ_VALUE_OK;
+}
+
+#ifdef CEL_HAVE_ZLIB
+static char start_CELstream_gzip(CELstream *s){
+  z_stream *z = (z_stream*)s->state;
+  memset(z, 0, sizeof(z_stream));
+  // Accept both gzip and zlib headers:
+  if(inflateInit2(z, 15 + 32) != Z_OK) return CEL_READ_VALUE_FAILED;
+  return CEL_READ_VALUE_OK;
+}
+
+static void stop_CELstream_gzip(CELstream *s){
+  inflateEnd((z_stream*)s->state);
+}
+
+static size_t read_CELstream_gzip(CELstream *s, void *buffer, size_t n){
+  z_stream *z = (z_stream*)s->state;
+  int result;
+  if(n > CEL_STREAM_READ_MAX) n = CEL_STREAM_READ_MAX;
+  z->next_out = (Bytef*)buffer;
+  z->avail_out = n;
+  while((z->avail_out > 0) && (s->end == 0)){
+    if(z->avail_in == 0){
+      z->avail_in = fill_CELstream_input(s);
+      z->next_in = s->input;
+      if(z->avail_in == 0){
+        s->end = 1;
+        break;
+      }
+    }
+    result = inflate(z, Z_NO_FLUSH);
+    // Concatenated members are read as a single stream:
+    if(result == Z_STREAM_END){
+      if(inflateReset(z) != Z_OK) s->end = 1;
+    } else if(result != Z_OK) s->end = 1;
+  }
+  return n - z->avail_out;
+}
+#endif
+
+#ifdef CEL_HAVE_BZIP2
+static char start_CELstream_bzip2(CELstream *s){
+  bz_stream *b = (bz_stream*)s->state;
+  memset(b, 0, sizeof(bz_stream));
+  if(BZ2_bzDecompressInit(b, 0, 0) != BZ_OK) return CEL_READ_VALUE_FAILED;
+  return CEL_READ_VALUE_OK;
+}
+
+static void stop_CELstream_bzip2(CELstream *s){
+  BZ2_bzDecompressEnd((bz_stream*)s->state);
+}
+
+static size_t read_CELstream_bzip2(CELstream *s, void *buffer, size_t n){
+  bz_stream *b = (bz_stream*)s->state;
+  bz_stream next;
+  int result;
+  if(n > CEL_STREAM_READ_MAX) n = CEL_STREAM_READ_MAX;
+  b->next_out = (char*)buffer;
+  b->avail_out = n;
+  while((b->avail_out > 0) && (s->end == 0)){
+    if(b->avail_in == 0){
+      b->avail_in = fill_CELstream_input(s);
+      b->next_in = (char*)s->input;
+      if(b->avail_in == 0){
+        s->end = 1;
+        break;
+      }
+    }
+    result = BZ2_bzDecompress(b);
+    // Concatenated streams (as written by parallel compressors) are read as one, keeping the buffers:
+    if(result == BZ_STREAM_END){
+      next = *b;
+      BZ2_bzDecompressEnd(b);
+      if(start_CELstream_bzip2(s) != CEL_READ_VALUE_OK) s->end = 1;
+      b->next_in = next.next_in;
+      b->avail_in = next.avail_in;
+      b->next_out = next.next_out;
+      b->avail_out = next.avail_out;
+    } else if(result != BZ_OK) s->end = 1;
+  }
+  return n - b->avail_out;
+}
+#endif
+
+#ifdef CEL_HAVE_LZMA
+static char start_CELstream_xz(CELstream *s){
+  lzma_stream *x = (lzma_stream*)s->state;
+  lzma_stream empty = LZMA_STREAM_INIT;
+  *x = empty;
+  if(lzma_stream_decoder(x, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK) return CEL_READ_VALUE_FAILED;
+  return CEL_READ_VALUE_OK;
+}
+
+static void stop_CELstream_xz(CELstream *s){
+  lzma_end((lzma_stream*)s->state);
+}
+
+static size_t read_CELstream_xz(CELstream *s, void *buffer, size_t n){
+  lzma_stream *x = (lzma_stream*)s->state;
+  if(n > CEL_STREAM_READ_MAX) n = CEL_STREAM_READ_MAX;
+  x->next_out = (uint8_t*)buffer;
+  x->avail_out = n;
+  while((x->avail_out > 0) && (s->end == 0)){
+    if((x->avail_in == 0) && (s->input_end == 0)){
+      x->avail_in = fill_CELstream_input(s);
+      x->next_in = s->input;
+      if(x->avail_in == 0) s->input_end = 1;
+    }
+    // The decoder needs to be told when the input has run out to finish (or fail) cleanly:
+    if(lzma_code(x, (s->input_end == 1) ? LZMA_FINISH : LZMA_RUN) != LZMA_OK) s->end = 1;
+  }
+  return n - x->avail_out;
+}
+#endif
+
+CELstream *open_CELstream_file(FILE *handle){
+  CELstream *s;
+  s = new_CELstream(CEL_STREAM_FILE);
+  if(s == NULL) return NULL;
+  s->handle = handle;
+  s->read = &read_CELstream_file;
+  s->seek = &seek_CELstream_file;
+  return s;
+}
+
+CELstream *open_CELstream_window(CELstream *source, long start, long size){
+  CELstream *s;
+  CELstream_window *w;
+  if((start < 0) || (size < 0)) return NULL;
+  s = new_CELstream(CEL_STREAM_WINDOW);
+  if(s == NULL) return NULL;
+  w = (CELstream_window*)malloc(sizeof(CELstream_window));
+  if(w == NULL){
+    free(s);
+    return NULL;
+  }
+  w->source = source;
+  w->start = start;
+  w->size = size;
+  w->pos = 0;
+  s->state = w;
+  s->read = &read_CELstream_window;
+  s->seek = &seek_CELstream_window;
+  return s;
+}
+
+CELstream *open_CELstream_prefix(CELstream *source, const unsigned char *data, size_t size){
+  CELstream *s;
+  CELstream_prefix *p;
+  s = new_CELstream(CEL_STREAM_PREFIX);
+  if(s == NULL) return NULL;
+  p = (CELstream_prefix*)malloc(sizeof(CELstream_prefix));
+  if(p == NULL){
+    free(s);
+    return NULL;
+  }
+  p->source = source;
+  p->data = data;
+  p->size = size;
+  p->pos = 0;
+  s->state = p;
+  s->read = &read_CELstream_prefix;
+  s->seek = &seek_CELstream_prefix;
+  return s;
+}
+
+CELstream *open_CELstream_decoder(CELstream *source){
+  unsigned char magic[CEL_STREAM_PEEK_SIZE];
+  size_t n;
+  char type;
+  CELstream *s;
+  // Peeking leaves the source where it is, so plain streams are returned untouched:
+  n = peek_CELstream(source, magic, 6);
+  type = sniff_CELstream(magic, n);
+  if(type == CEL_STREAM_FILE) return source;
+  s = new_CELstream(type);
+  if(s == NULL) return NULL;
+  s->source = source;
+#ifdef CEL_HAVE_ZLIB
+  if(type == CEL_STREAM_GZIP){
+    s->state = malloc(sizeof(z_stream));
+    s->read = &read_CELstream_gzip;
+    s->start = &start_CELstream_gzip;
+    s->stop = &stop_CELstream_gzip;
+  }
+#endif
+#ifdef CEL_HAVE_BZIP2
+  if(type == CEL_STREAM_BZIP2){
+    s->state = malloc(sizeof(bz_stream));
+    s->read = &read_CELstream_bzip2;
+    s->start = &start_CELstream_bzip2;
+    s->stop = &stop_CELstream_bzip2;
+  }
+#endif
+#ifdef CEL_HAVE_LZMA
+  if(type == CEL_STREAM_XZ){
+    s->state = malloc(sizeof(lzma_stream));
+    s->read = &read_CELstream_xz;
+    s->start = &start_CELstream_xz;
+    s->stop = &stop_CELstream_xz;
+  }
+#endif
+  s->input = (unsigned char*)malloc(CEL_STREAM_INPUT_SIZE);
+  if((s->state == NULL) || (s->input == NULL) || (s->start(s) != CEL_READ_VALUE_OK)){
+    free(s->state);
+    free(s->input);
+    free(s);
+    return NULL;
+  }
+  return s;
+}
+
+CELstream *open_CELstream(FILE *handle){
+  CELstream *file, *s;
+  file = open_CELstream_file(handle);
+  if(file == NULL) return NULL;
+  s = open_CELstream_decoder(file);
+  if(s == NULL) close_CELstream(file);
+  return s;
+}
+
+void close_CELstream(CELstream *s){
+  CELstream *source;
+  // Each decoder owns the stream it reads from, while windows and file handles are left to their owners:
+  while(s != NULL){
+    if((s->stop != NULL) && (s->state != NULL)) s->stop(s);
+    free(s->state);
+    free(s->input);
+    source = s->source;
+    free(s);
+    s = source;
+  }
+}
+
+size_t read_CELstream(CELstream *s, void *buffer, size_t n){
+  size_t count = 0, result;
+  // Peeked bytes are handed out before anything new is read:
+  if(s->peek_start < s->peek_end){
+    count = s->peek_end - s->peek_start;
+    if(count > n) count = n;
+    memcpy(buffer, s->peek + s->peek_start, count);
+    s->peek_start += count;
+  }
+  while(count < n){
+    result = s->read(s, (unsigned char*)buffer + count, n - count);
+    if(result == 0) break;
+    count += result;
+  }
+  s->pos += count;
+  return count;
+}
+
+size_t peek_CELstream(CELstream *s, void *buffer, size_t n){
+  size_t result;
+  if(n > CEL_STREAM_PEEK_SIZE) n = CEL_STREAM_PEEK_SIZE;
+  // Keep any peeked bytes not yet read, and top them up:
+  if(s->peek_start > 0){
+    memmove(s->peek, s->peek + s->peek_start, s->peek_end - s->peek_start);
+    s->peek_end -= s->peek_start;
+    s->peek_start = 0;
+  }
+  while(s->peek_end < n){
+    result = s->read(s, s->peek + s->peek_end, n - s->peek_end);
+    if(result == 0) break;
+    s->peek_end += result;
+  }
+  if(n > s->peek_end) n = s->peek_end;
+  memcpy(buffer, s->peek, n);
+  return n;
+}
+
+char is_CELstream_failed(CELstream *s){
+  // The error flag may be set by positional reads on other threads:
+  for(; s != NULL; s = s->source) if(__atomic_load_n(&s->error, __ATOMIC_RELAXED) == 1) return 1;
+  return 0;
+}
+
+long size_CELstream(CELstream *s){
+  struct stat info;
+  if(s->type == CEL_STREAM_WINDOW) return ((CELstream_window*)s->state)->size;
+  if(s->type == CEL_STREAM_PREFIX) return size_CELstream(((CELstream_prefix*)s->state)->source);
+  if(s->type != CEL_STREAM_FILE) return -1;
+  if(fstat(fileno(s->handle), &info) != 0) return -1;
+  return info.st_size;
+}
+
+// Start a stream again from the beginning of its source:
+static char restart_CELstream(CELstream *s){
+  if(s->start == NULL) return CEL_READ_VALUE_FAILED;
+  s->stop(s);
+  s->end = 1;
+  s->pos = 0;
+  s->peek_start = 0;
+  s->peek_end = 0;
+  if(seek_CELstream(s->source, 0) != CEL_READ_VALUE_OK) return CEL_READ_VALUE_FAILED;
+  if(s->start(s) != CEL_READ_VALUE_OK) return CEL_READ_VALUE_FAILED;
+  s->end = 0;
+  s->input_end = 0;
+  return CEL_READ_VALUE_OK;
+}
+
+char seek_CELstream(CELstream *s, long offset){
+  unsigned char skip[CEL_STREAM_SKIP_SIZE];
+  size_t n;
+  if(offset < 0) return CEL_READ_VALUE_FAILED;
+  if(offset == s->pos) return CEL_READ_VALUE_OK;
+  if(s->seek != NULL){
+    if(s->seek(s, offset) != CEL_READ_VALUE_OK) return CEL_READ_VALUE_FAILED;
+    s->pos = offset;
+    s->peek_start = 0;
+    s->peek_end = 0;
+    return CEL_READ_VALUE_OK;
+  }
+  // Streams that cannot seek go back to the start if they must, and read forward to the offset:
+  if((offset < s->pos) && (restart_CELstream(s) != CEL_READ_VALUE_OK)) return CEL_READ_VALUE_FAILED;
+  while(s->pos < offset){
+    n = offset - s->pos;
+    if(n > CEL_STREAM_SKIP_SIZE) n = CEL_STREAM_SKIP_SIZE;
+    if(read_CELstream(s, skip, n) != n) return CEL_READ_VALUE_FAILED;
+  }
+  return CEL_READ_VALUE_OK;
+}
@@ -0,0 +1,78 @@
+// checkcel - check the validity of an Affymetrix CEL file.
+// Copyright (C) 2016 Alastair Droop, The Leeds MRC Medical Bioinformatics Centre <a.p.droop@leeds.ac.uk>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __checkcel_celstream_h
+#define __checkcel_celstream_h
+
+//Define the input stream types:
+#define CEL_STREAM_FILE 0
+#define CEL_STREAM_GZIP 1
+#define CEL_STREAM_BZIP2 2
+#define CEL_STREAM_XZ 3
+#define CEL_STREAM_WINDOW 4
+#define CEL_STREAM_PREFIX 5
+
+// Define the buffer sizes used to feed the decompressors and skip unwanted data:
+#define CEL_STREAM_INPUT_SIZE 65536
+#define CEL_STREAM_SKIP_SIZE 16384
+#define CEL_STREAM_PEEK_SIZE 8
+
+// Define the struct to hold a sequential input stream. Each stream type supplies functions to read
+// from the current position and to (re)start from the beginning of its source; seeks are emulated
+// by restarting and reading forward where the stream type cannot seek itself:
+typedef struct CELstream CELstream;
+struct CELstream {
+  char type;
+  char end;
+  char error;
+  char input_end;
+  long pos;
+  FILE *handle;
+  CELstream *source;
+  void *state;
+  unsigned char *input;
+  unsigned char peek[CEL_STREAM_PEEK_SIZE];
+  size_t peek_start;
+  size_t peek_end;
+  size_t (*read)(CELstream *s, void *buffer, size_t n);
+  char (*seek)(CELstream *s, long offset);
+  char (*start)(CELstream *s);
+  void (*stop)(CELstream *s);
+};
+
+// Function to identify a compressed stream from its first bytes:
+char sniff_CELstream(const unsigned char *data, size_t n);
+
+// Functions to open a stream over a file, and to wrap a stream in a decompressor if it needs one:
+CELstream *open_CELstream_file(FILE *handle);
+CELstream *open_CELstream_decoder(CELstream *source);
+CELstream *open_CELstream(FILE *handle);
+CELstream *open_CELstream_window(CELstream *source, long start, long size);
+CELstream *open_CELstream_prefix(CELstream *source, const unsigned char *data, size_t size);
+void close_CELstream(CELstream *s);
+
+// Functions to read from and position a stream:
+size_t read_CELstream(CELstream *s, void *buffer, size_t n);
+size_t peek_CELstream(CELstream *s, void *buffer, size_t n);
+char seek_CELstream(CELstream *s, long offset);
+
+// Function to check whether a stream, or any stream it reads from, failed to read its file:
+char is_CELstream_failed(CELstream *s);
+
+// Function to report the length of a stream (-1 if it is not known without reading it):
+long size_CELstream(CELstream *s);
+
+#endif
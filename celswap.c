@@ -0,0 +1,161 @@
+// checkcel - check the validity of an Affymetrix CEL file.
+// Copyright (C) 2016 Alastair Droop, The Leeds MRC Medical Bioinformatics Centre <a.p.droop@leeds.ac.uk>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <stdio.h>
+#include "cel.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CEL_SWAP_X86 1
+#include <immintrin.h>
+#endif
+
+static void swap_CEL_16_scalar(void *value, const void *buffer, size_t n){
+  size_t i;
+  const unsigned char *in = (const unsigned char*)buffer;
+  unsigned char *out = (unsigned char*)value;
+  unsigned char a, b;
+  for(i=0; i<n; i++){
+    a = in[0 + (i * 2)];
+    b = in[1 + (i * 2)];
+    out[0 + (i * 2)] = b;
+    out[1 + (i * 2)] = a;
+  }
+}
+
+static void swap_CEL_32_scalar(void *value, const void *buffer, size_t n){
+  size_t i;
+  const unsigned char *in = (const unsigned char*)buffer;
+  unsigned char *out = (unsigned char*)value;
+  unsigned char a, b, c, d;
+  for(i=0; i<n; i++){
+    a = in[0 + (i * 4)];
+    b = in[1 + (i * 4)];
+    c = in[2 + (i * 4)];
+    d = in[3 + (i * 4)];
+    out[0 + (i * 4)] = d;
+    out[1 + (i * 4)] = c;
+    out[2 + (i * 4)] = b;
+    out[3 + (i * 4)] = a;
+  }
+}
+
+#ifdef CEL_SWAP_X86
+
+// SSE2 has no byte shuffle, so swap the bytes in each 16-bit lane with shifts, then swap the lanes:
+__attribute__((target("sse2")))
+static void swap_CEL_16_sse2(void *value, const void *buffer, size_t n){
+  size_t i;
+  __m128i x;
+  const unsigned char *in = (const unsigned char*)buffer;
+  unsigned char *out = (unsigned char*)value;
+  for(i=0; i + 8 <= n; i += 8){
+    x = _mm_loadu_si128((const __m128i*)(in + (i * 2)));
+    x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+    _mm_storeu_si128((__m128i*)(out + (i * 2)), x);
+  }
+  swap_CEL_16_scalar(out + (i * 2), in + (i * 2), n - i);
+}
+
+__attribute__((target("sse2")))
+static void swap_CEL_32_sse2(void *value, const void *buffer, size_t n){
+  size_t i;
+  __m128i x;
+  const unsigned char *in = (const unsigned char*)buffer;
+  unsigned char *out = (unsigned char*)value;
+  for(i=0; i + 4 <= n; i += 4){
+    x = _mm_loadu_si128((const __m128i*)(in + (i * 4)));
+    x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+    x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+    x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+    _mm_storeu_si128((__m128i*)(out + (i * 4)), x);
+  }
+  swap_CEL_32_scalar(out + (i * 4), in + (i * 4), n - i);
+}
+
+// AVX2 reverses the bytes of each value with a single shuffle, two vectors at a time:
+__attribute__((target("avx2")))
+static void swap_CEL_16_avx2(void *value, const void *buffer, size_t n){
+  size_t i;
+  __m256i x, y;
+  const __m256i mask = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+  const unsigned char *in = (const unsigned char*)buffer;
+  unsigned char *out = (unsigned char*)value;
+  for(i=0; i + 32 <= n; i += 32){
+    x = _mm256_loadu_si256((const __m256i*)(in + (i * 2)));
+    y = _mm256_loadu_si256((const __m256i*)(in + (i * 2) + 32));
+    _mm256_storeu_si256((__m256i*)(out + (i * 2)), _mm256_shuffle_epi8(x, mask));
+    _mm256_storeu_si256((__m256i*)(out + (i * 2) + 32), _mm256_shuffle_epi8(y, mask));
+  }
+  swap_CEL_16_sse2(out + (i * 2), in + (i * 2), n - i);
+}
+
+__attribute__((target("avx2")))
+static void swap_CEL_32_avx2(void *value, const void *buffer, size_t n){
+  size_t i;
+  __m256i x, y;
+  const __m256i mask = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  const unsigned char *in = (const unsigned char*)buffer;
+  unsigned char *out = (unsigned char*)value;
+  for(i=0; i + 16 <= n; i += 16){
+    x = _mm256_loadu_si256((const __m256i*)(in + (i * 4)));
+    y = _mm256_loadu_si256((const __m256i*)(in + (i * 4) + 32));
+    _mm256_storeu_si256((__m256i*)(out + (i * 4)), _mm256_shuffle_epi8(x, mask));
+    _mm256_storeu_si256((__m256i*)(out + (i * 4) + 32), _mm256_shuffle_epi8(y, mask));
+  }
+  swap_CEL_32_sse2(out + (i * 4), in + (i * 4), n - i);
+}
+
+#endif
+
+char check_CELswap(){
+#ifdef CEL_SWAP_X86
+  if(__builtin_cpu_supports("avx2")) return CEL_SWAP_AVX2;
+  if(__builtin_cpu_supports("sse2")) return CEL_SWAP_SSE2;
+#endif
+  return CEL_SWAP_SCALAR;
+}
+
+// The kernels are chosen once, the first time either is needed:
+typedef void (*CELswap_kernel)(void *value, const void *buffer, size_t n);
+static CELswap_kernel CELswap_16 = &swap_CEL_16_scalar;
+static CELswap_kernel CELswap_32 = &swap_CEL_32_scalar;
+static pthread_once_t CELswap_once = PTHREAD_ONCE_INIT;
+
+static void init_CELswap(){
+#ifdef CEL_SWAP_X86
+  char kernel = check_CELswap();
+  if(kernel == CEL_SWAP_AVX2){
+    CELswap_16 = &swap_CEL_16_avx2;
+    CELswap_32 = &swap_CEL_32_avx2;
+  } else if(kernel == CEL_SWAP_SSE2){
+    CELswap_16 = &swap_CEL_16_sse2;
+    CELswap_32 = &swap_CEL_32_sse2;
+  }
+#endif
+}
+
+void swap_CEL_16(void *value, const void *buffer, size_t n){
+  pthread_once(&CELswap_once, init_CELswap);
+  CELswap_16(value, buffer, n);
+}
+
+void swap_CEL_32(void *value, const void *buffer, size_t n){
+  pthread_once(&CELswap_once, init_CELswap);
+  CELswap_32(value, buffer, n);
+}
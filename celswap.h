@@ -0,0 +1,32 @@
+// checkcel - check the validity of an Affymetrix CEL file.
+// Copyright (C) 2016 Alastair Droop, The Leeds MRC Medical Bioinformatics Centre <a.p.droop@leeds.ac.uk>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __checkcel_celswap_h
+#define __checkcel_celswap_h
+
+//Define the byte-swap kernel implementations:
+#define CEL_SWAP_SCALAR 0
+#define CEL_SWAP_SSE2 1
+#define CEL_SWAP_AVX2 2
+
+// Function to report the kernel used on this machine:
+char check_CELswap();
+
+// Functions to reverse the byte order of packed 16- and 32-bit values (value and buffer may be the same):
+void swap_CEL_16(void *value, const void *buffer, size_t n);
+void swap_CEL_32(void *value, const void *buffer, size_t n);
+
+#endif
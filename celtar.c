@@ -0,0 +1,183 @@
+// checkcel - check the validity of an Affymetrix CEL file.
+// Copyright (C) 2016 Alastair Droop, The Leeds MRC Medical Bioinformatics Centre <a.p.droop@leeds.ac.uk>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include "cel.h"
+
+// Define the largest pax extended header read when looking for a member path:
+#define CEL_TAR_PAX_MAX 1048576
+
+char is_CELtar(CELfile f){
+  char magic[5];
+  // POSIX and GNU archives both mark their first header in the same place:
+  if(readCEL_at(magic, 5, 257, f) != 5) return 0;
+  return (memcmp(magic, "ustar", 5) == 0);
+}
+
+// Decode a numeric header field, which is octal text or (for large values) base-256 binary:
+static long parse_CELtar_number(const unsigned char *field, size_t n){
+  long value = 0;
+  size_t i = 0;
+  if((field[0] & 0x80) != 0){
+    value = field[0] & 0x7f;
+    for(i=1; i<n; i++) value = (value << 8) | field[i];
+    return value;
+  }
+  while((i < n) && (field[i] == ' ')) i++;
+  while((i < n) && (field[i] >= '0') && (field[i] <= '7')) value = (value * 8) + (field[i++] - '0');
+  return value;
+}
+
+// Check a header's checksum, which is calculated with the checksum field itself taken as spaces:
+static char check_CELtar_header(const unsigned char *header){
+  long sum = 0;
+  int i;
+  for(i=0; i<CEL_TAR_BLOCK_SIZE; i++){
+    if((i >= 148) && (i < 156)) sum += ' ';
+    else sum += header[i];
+  }
+  return (sum == parse_CELtar_number(header + 148, 8));
+}
+
+// An archive ends with a block of zeros:
+static char is_CELtar_end(const unsigned char *header){
+  int i;
+  for(i=0; i<CEL_TAR_BLOCK_SIZE; i++) if(header[i] != 0) return 0;
+  return 1;
+}
+
+// Read the name given by a GNU long name entry, or the path in a pax extended header, for the next member:
+static void read_CELtar_name(CELstream *s, char type, long size, char *name){
+  char *data, *p, *end, *record;
+  long length;
+  name[0] = '\0';
+  if((size <= 0) || (size > CEL_TAR_PAX_MAX)) return;
+  data = (char*)malloc(size + 1);
+  if(data == NULL) return;
+  if(read_CELstream(s, data, size) != size){
+    free(data);
+    return;
+  }
+  data[size] = '\0';
+  if(type == 'L'){
+    strncpy(name, data, CEL_TAR_NAME_MAX);
+    name[CEL_TAR_NAME_MAX] = '\0';
+    free(data);
+    return;
+  }
+  // Pax records are written as "<length> <key>=<value>\n", with the length covering the whole record:
+  p = data;
+  end = data + size;
+  while(p < end){
+    length = strtol(p, &record, 10);
+    if((length <= 0) || (length > end - p) || (*record != ' ')) break;
+    record++;
+    if((strncmp(record, "path=", 5) == 0) && (p[length - 1] == '\n')){
+      record += 5;
+      length = (p + length - 1) - record;
+      if(length > CEL_TAR_NAME_MAX) length = CEL_TAR_NAME_MAX;
+      memcpy(name, record, length);
+      name[length] = '\0';
+      break;
+    }
+    p += length;
+  }
+  free(data);
+}
+
+// Build the full name of a member from its header, unless a long name has already been given:
+static void get_CELtar_name(const unsigned char *header, char *name){
+  size_t prefix_length, name_length;
+  if(name[0] != '\0') return;
+  prefix_length = strnlen((const char*)header + 345, 155);
+  name_length = strnlen((const char*)header, 100);
+  if((header[257 + 5] == '\0') && (prefix_length > 0)){
+    memcpy(name, header + 345, prefix_length);
+    name[prefix_length++] = '/';
+  } else prefix_length = 0;
+  memcpy(name + prefix_length, header, name_length);
+  name[prefix_length + name_length] = '\0';
+}
+
+// Return the result to use for the next member (or for the archive itself if member is NULL). The first
+// is stored in place of the archive's own result, and the rest are chained after it:
+static CELresult *next_CELtar_result(CELresult *r, CELresult **last, char *archive, char *member){
+  CELresult *result = r;
+  if(*last != NULL){
+    result = (CELresult*)malloc(sizeof(CELresult));
+    if(result == NULL) return NULL;
+    init_CELresult(result);
+    (*last)->next = result;
+  } else if(r->name != NULL){
+    free(r->name);
+    r->name = NULL;
+  }
+  *last = result;
+  if(member == NULL) member = "";
+  result->name = (char*)malloc(strlen(archive) + strlen(member) + 2);
+  if(result->name == NULL) return result;
+  if(member[0] == '\0') strcpy(result->name, archive);
+  else sprintf(result->name, "%s:%s", archive, member);
+  return result;
+}
+
+void check_CELtar(CELfile f, CELcheck_options *o, CELresult *r){
+  unsigned char header[CEL_TAR_BLOCK_SIZE];
+  char name[CEL_TAR_NAME_MAX + 1];
+  long offset = 0, size;
+  char type, complete = 0;
+  CELresult *result, *last = NULL;
+  CELstream *archive, *window;
+  CELfile member;
+  if((f.open != 1) || (f.stream == NULL) || (f.prefix == NULL)) return;
+  // The walk starts from the block already read when the file was opened, so a compressed archive is
+  // not decoded again from its beginning:
+  archive = open_CELstream_prefix(f.stream, f.prefix->data, f.prefix->size);
+  if(archive == NULL) return;
+  name[0] = '\0';
+  // Headers and members are read in order, so the archive is only read once:
+  while(1){
+    if(seek_CELstream(archive, offset) != CEL_READ_VALUE_OK) break;
+    if(read_CELstream(archive, header, CEL_TAR_BLOCK_SIZE) != CEL_TAR_BLOCK_SIZE) break;
+    if(is_CELtar_end(header) == 1){
+      complete = 1;
+      break;
+    }
+    if(check_CELtar_header(header) != 1) break;
+    size = parse_CELtar_number(header + 124, 12);
+    if(size < 0) break;
+    type = header[156];
+    if((type == 'L') || (type == 'x')) read_CELtar_name(archive, type, size, name);
+    else {
+      // Regular files are checked through a window onto the archive; other entries are skipped:
+      if((type == '0') || (type == '\0') || (type == '7')){
+        get_CELtar_name(header, name);
+        result = next_CELtar_result(r, &last, f.name, name);
+        window = open_CELstream_window(archive, offset + CEL_TAR_BLOCK_SIZE, size);
+        if((result != NULL) && (window != NULL)){
+          member = open_CELfile_stream(name, window);
+          check_CELfile(member, o, result);
+          close_CELfile(member);
+        } else if(window != NULL) close_CELstream(window);
+      }
+      name[0] = '\0';
+    }
+    offset += CEL_TAR_BLOCK_SIZE + (((size + CEL_TAR_BLOCK_SIZE - 1) / CEL_TAR_BLOCK_SIZE) * CEL_TAR_BLOCK_SIZE);
+  }
+  close_CELstream(archive);
+  // A damaged archive is reported under its own name after the members that could be read:
+  if((complete != 1) && (last != NULL)) next_CELtar_result(r, &last, f.name, NULL);
+}
@@ -0,0 +1,30 @@
+// checkcel - check the validity of an Affymetrix CEL file.
+// Copyright (C) 2016 Alastair Droop, The Leeds MRC Medical Bioinformatics Centre <a.p.droop@leeds.ac.uk>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __checkcel_celtar_h
+#define __checkcel_celtar_h
+
+// Define the tar block size, and the longest member name kept:
+#define CEL_TAR_BLOCK_SIZE 512
+#define CEL_TAR_NAME_MAX 4096
+
+// Function to test whether an open file is a (possibly compressed) tar archive:
+char is_CELtar(CELfile f);
+
+// Check each member of an open tar archive in a single pass, chaining one result per member onto r:
+void check_CELtar(CELfile f, CELcheck_options *o, CELresult *r);
+
+#endif
@@ -0,0 +1,211 @@
+// checkcel - check the validity of an Affymetrix CEL file.
+// Copyright (C) 2016 Alastair Droop, The Leeds MRC Medical Bioinformatics Centre <a.p.droop@leeds.ac.uk>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "cel.h"
+
+#ifdef CEL_HAVE_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+// The rings are shared with the kernel, so their indices are read and written with barriers:
+#define CEL_URING_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define CEL_URING_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+CELuring *create_CELuring(unsigned int entries){
+  CELuring *u;
+  struct io_uring_params params;
+  unsigned char *sq, *cq;
+  u = (CELuring*)malloc(sizeof(CELuring));
+  if(u == NULL) return NULL;
+  memset(&params, 0, sizeof(params));
+  u->sq_ring = MAP_FAILED;
+  u->cq_ring = MAP_FAILED;
+  u->sqes = MAP_FAILED;
+  u->pending = 0;
+  // Kernels without io_uring (or with it disabled) fail here, and the caller falls back to stdio:
+  u->fd = syscall(__NR_io_uring_setup, entries, &params);
+  if(u->fd < 0){
+    free(u);
+    return NULL;
+  }
+  u->entries = params.sq_entries;
+  u->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+  u->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  // Newer kernels map both rings at once:
+  if(params.features & IORING_FEAT_SINGLE_MMAP){
+    if(u->cq_ring_size > u->sq_ring_size) u->sq_ring_size = u->cq_ring_size;
+    u->cq_ring_size = u->sq_ring_size;
+  }
+  u->sq_ring = mmap(NULL, u->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+  if(u->sq_ring == MAP_FAILED){
+    free_CELuring(u);
+    return NULL;
+  }
+  if(params.features & IORING_FEAT_SINGLE_MMAP) u->cq_ring = u->sq_ring;
+  else {
+    u->cq_ring = mmap(NULL, u->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+    if(u->cq_ring == MAP_FAILED){
+      free_CELuring(u);
+      return NULL;
+    }
+  }
+  u->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+  if(u->sqes == MAP_FAILED){
+    free_CELuring(u);
+    return NULL;
+  }
+  sq = (unsigned char*)u->sq_ring;
+  cq = (unsigned char*)u->cq_ring;
+  u->sq_head = (unsigned int*)(sq + params.sq_off.head);
+  u->sq_tail = (unsigned int*)(sq + params.sq_off.tail);
+  u->sq_mask = (unsigned int*)(sq + params.sq_off.ring_mask);
+  u->sq_array = (unsigned int*)(sq + params.sq_off.array);
+  u->cq_head = (unsigned int*)(cq + params.cq_off.head);
+  u->cq_tail = (unsigned int*)(cq + params.cq_off.tail);
+  u->cq_mask = (unsigned int*)(cq + params.cq_off.ring_mask);
+  u->cqes = cq + params.cq_off.cqes;
+  return u;
+}
+
+void free_CELuring(CELuring *u){
+  if(u == NULL) return;
+  if(u->sqes != MAP_FAILED) munmap(u->sqes, u->sqes_size);
+  if((u->cq_ring != MAP_FAILED) && (u->cq_ring != u->sq_ring)) munmap(u->cq_ring, u->cq_ring_size);
+  if(u->sq_ring != MAP_FAILED) munmap(u->sq_ring, u->sq_ring_size);
+  close(u->fd);
+  free(u);
+}
+
+// Claim the next free submission queue entry (NULL if the queue is full):
+static struct io_uring_sqe *next_CELuring_sqe(CELuring *u){
+  unsigned int tail, index;
+  struct io_uring_sqe *sqe;
+  tail = *u->sq_tail;
+  if(tail - CEL_URING_LOAD(u->sq_head) >= u->entries) return NULL;
+  index = tail & *u->sq_mask;
+  sqe = &((struct io_uring_sqe*)u->sqes)[index];
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  u->sq_array[index] = index;
+  return sqe;
+}
+
+// Make a claimed entry visible to the kernel:
+static void push_CELuring_sqe(CELuring *u){
+  CEL_URING_STORE(u->sq_tail, *u->sq_tail + 1);
+  u->pending++;
+}
+
+char queue_CELuring_open(CELuring *u, const char *path, u_int64_t tag){
+  struct io_uring_sqe *sqe;
+  sqe = next_CELuring_sqe(u);
+  if(sqe == NULL) return CEL_READ_VALUE_FAILED;
+  sqe->opcode = IORING_OP_OPENAT;
+  sqe->fd = AT_FDCWD;
+  sqe->addr = (u_int64_t)(uintptr_t)path;
+  sqe->open_flags = O_RDONLY | O_CLOEXEC;
+  sqe->user_data = tag;
+  push_CELuring_sqe(u);
+  return CEL_READ_VALUE_OK;
+}
+
+char queue_CELuring_read(CELuring *u, int fd, void *buffer, unsigned int n, u_int64_t tag){
+  struct io_uring_sqe *sqe;
+  sqe = next_CELuring_sqe(u);
+  if(sqe == NULL) return CEL_READ_VALUE_FAILED;
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = fd;
+  sqe->addr = (u_int64_t)(uintptr_t)buffer;
+  sqe->len = n;
+  sqe->off = 0;
+  sqe->user_data = tag;
+  push_CELuring_sqe(u);
+  return CEL_READ_VALUE_OK;
+}
+
+char submit_CELuring(CELuring *u){
+  int n;
+  while(u->pending > 0){
+    n = syscall(__NR_io_uring_enter, u->fd, u->pending, 0, 0, NULL, 0);
+    if(n < 0){
+      if(errno == EINTR) continue;
+      // A busy ring keeps its requests queued, and they are submitted again by the next wait:
+      return CEL_READ_VALUE_FAILED;
+    }
+    if(n == 0) break;
+    u->pending -= n;
+  }
+  return CEL_READ_VALUE_OK;
+}
+
+char wait_CELuring(CELuring *u, u_int64_t *tag, int *result){
+  unsigned int head;
+  struct io_uring_cqe *cqe;
+  int n;
+  while(1){
+    // Take the next completion if there is one:
+    head = *u->cq_head;
+    if(head != CEL_URING_LOAD(u->cq_tail)){
+      cqe = &((struct io_uring_cqe*)u->cqes)[head & *u->cq_mask];
+      *tag = cqe->user_data;
+      *result = cqe->res;
+      CEL_URING_STORE(u->cq_head, head + 1);
+      return CEL_READ_VALUE_OK;
+    }
+    // Otherwise submit everything queued so far, and wait for something to finish:
+    n = syscall(__NR_io_uring_enter, u->fd, u->pending, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    if(n < 0){
+      if(errno == EINTR) continue;
+      return CEL_READ_VALUE_FAILED;
+    }
+    u->pending -= n;
+  }
+}
+
+#else
+
+// Without io_uring support every ring fails to start, so files are always read through stdio:
+CELuring *create_CELuring(unsigned int entries){
+  return NULL;
+}
+
+void free_CELuring(CELuring *u){
+}
+
+char queue_CELuring_open(CELuring *u, const char *path, u_int64_t tag){
+  return CEL_READ_VALUE_FAILED;
+}
+
+char queue_CELuring_read(CELuring *u, int fd, void *buffer, unsigned int n, u_int64_t tag){
+  return CEL_READ_VALUE_FAILED;
+}
+
+char submit_CELuring(CELuring *u){
+  return CEL_READ_VALUE_FAILED;
+}
+
+char wait_CELuring(CELuring *u, u_int64_t *tag, int *result){
+  return CEL_READ_VALUE_FAILED;
+}
+
+#endif
@@ -0,0 +1,59 @@
+// checkcel - check the validity of an Affymetrix CEL file.
+// Copyright (C) 2016 Alastair Droop, The Leeds MRC Medical Bioinformatics Centre <a.p.droop@leeds.ac.uk>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef __checkcel_celuring_h
+#define __checkcel_celuring_h
+
+// Define the struct holding an io_uring submission and completion queue pair (see io_uring(7)):
+typedef struct {
+  int fd;
+  unsigned int entries;
+  unsigned int pending;
+  void *sq_ring;
+  size_t sq_ring_size;
+  void *cq_ring;
+  size_t cq_ring_size;
+  void *sqes;
+  size_t sqes_size;
+  unsigned int *sq_head;
+  unsigned int *sq_tail;
+  unsigned int *sq_mask;
+  unsigned int *sq_array;
+  unsigned int *cq_head;
+  unsigned int *cq_tail;
+  unsigned int *cq_mask;
+  void *cqes;
+} CELuring;
+
+// Create a ring with room for at least the given number of requests (NULL if io_uring is not available):
+CELuring *create_CELuring(unsigned int entries);
+void free_CELuring(CELuring *u);
+
+// Functions to queue requests, each tagged to identify its completion (these fail if the queue is full).
+// Queued requests are passed to the kernel by the next submit_CELuring() or wait_CELuring(), and their
+// arguments must stay valid until they complete:
+char queue_CELuring_open(CELuring *u, const char *path, u_int64_t tag);
+char queue_CELuring_read(CELuring *u, int fd, void *buffer, unsigned int n, u_int64_t tag);
+
+// Submit any queued requests without waiting for them:
+char submit_CELuring(CELuring *u);
+
+// Submit any queued requests and wait for the next completion, giving its tag and result (a descriptor or byte
+// count, or a negated errno value):
+char wait_CELuring(CELuring *u, u_int64_t *tag, int *result);
+
+#endif
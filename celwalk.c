@@ -0,0 +1,323 @@
+// checkcel - check the validity of an Affymetrix CEL file.
+// Copyright (C) 2016 Alastair Droop, The Leeds MRC Medical Bioinformatics Centre <a.p.droop@leeds.ac.uk>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "cel.h"
+
+// Define the initial number of entries held while a directory is read and sorted:
+#define CEL_WALK_ENTRY_STEP 64
+
+// Allocate an entry, taking over its path:
+static CELwalk_entry *new_CELwalk_entry(char *path, char is_directory, CELwalk_entry *parent){
+  CELwalk_entry *e;
+  e = (CELwalk_entry*)malloc(sizeof(CELwalk_entry));
+  if(e == NULL){
+    free(path);
+    return NULL;
+  }
+  e->path = path;
+  e->is_directory = is_directory;
+  e->state = CEL_WALK_UNREAD;
+  e->parent = parent;
+  e->children = NULL;
+  e->next = NULL;
+  e->queued = NULL;
+  return e;
+}
+
+// Free an entry and the siblings after it, with everything below them:
+static void free_CELwalk_entries(CELwalk_entry *e){
+  CELwalk_entry *next;
+  for(; e != NULL; e = next){
+    next = e->next;
+    free_CELwalk_entries(e->children);
+    free(e->path);
+    free(e);
+  }
+}
+
+// Order entries by path (all the entries of a directory share its path, so this is by name):
+static int compare_CELwalk_entries(const void *a, const void *b){
+  return strcmp((*(CELwalk_entry**)a)->path, (*(CELwalk_entry**)b)->path);
+}
+
+// Join a directory and an entry name into a new path:
+static char *join_CELwalk_path(const char *directory, const char *name){
+  size_t length = strlen(directory);
+  char *path;
+  path = (char*)malloc((length + strlen(name) + 2) * sizeof(char));
+  if(path == NULL) return NULL;
+  strcpy(path, directory);
+  if((length == 0) || (directory[length - 1] != '/')) path[length++] = '/';
+  strcpy(path + length, name);
+  return path;
+}
+
+// Check whether a name ends with the given suffix (ignoring case), returning the length before it:
+static size_t match_CELwalk_suffix(const char *name, size_t length, const char *suffix){
+  size_t n = strlen(suffix);
+  if((length <= n) || (strncasecmp(name + length - n, suffix, n) != 0)) return 0;
+  return length - n;
+}
+
+// Check whether a file's name marks it as a CEL file or archive (either possibly compressed):
+static char is_CELwalk_name(const char *name){
+  size_t length = strlen(name), stem;
+  if(match_CELwalk_suffix(name, length, ".tgz") > 0) return 1;
+  if((stem = match_CELwalk_suffix(name, length, ".gz")) > 0) length = stem;
+  else if((stem = match_CELwalk_suffix(name, length, ".bz2")) > 0) length = stem;
+  else if((stem = match_CELwalk_suffix(name, length, ".xz")) > 0) length = stem;
+  if(match_CELwalk_suffix(name, length, ".cel") > 0) return 1;
+  if(match_CELwalk_suffix(name, length, ".tar") > 0) return 1;
+  return 0;
+}
+
+// Check whether a file starts like a CEL file or archive. Compressed files cannot be told apart without
+// decompressing them, so are all checked:
+static char is_CELwalk_content(int directory_fd, const char *name){
+  unsigned char data[CEL_WALK_SNIFF_SIZE];
+  ssize_t n;
+  int fd;
+  fd = openat(directory_fd, name, O_RDONLY);
+  if(fd < 0) return 0;
+  n = pread(fd, data, CEL_WALK_SNIFF_SIZE, 0);
+  close(fd);
+  if(n <= 0) return 0;
+  if((n >= 2) && (data[0] == 59) && (data[1] == 1)) return 1;
+  if((n >= 8) && (memcmp(data, "\x40\0\0\0\x04\0\0\0", 8) == 0)) return 1;
+  if((n >= 5) && (memcmp(data, "[CEL]", 5) == 0)) return 1;
+  if((n >= 262) && (memcmp(data + 257, "ustar", 5) == 0)) return 1;
+  return (sniff_CELstream(data, n) != CEL_STREAM_FILE);
+}
+
+// Read a directory, sorting its matching files and subdirectories into the tree and stacking the
+// subdirectories for the traversal threads. Symbolic links to files are followed, but those to directories
+// are not, so cycles are impossible:
+static void read_CELwalk_directory(CELwalk *w, CELwalk_entry *directory){
+  DIR *d = NULL;
+  struct dirent *entry;
+  struct stat info;
+  char is_directory, is_file;
+  char *path;
+  int fd;
+  CELwalk_entry **entries = NULL, **larger, *e;
+  size_t entry_number = 0, entry_size = 0, file_number = 0, i;
+  fd = open(directory->path, O_RDONLY | O_DIRECTORY);
+  if(fd >= 0){
+    d = fdopendir(fd);
+    if(d == NULL) close(fd);
+  }
+  while((d != NULL) && ((entry = readdir(d)) != NULL)){
+    if((strcmp(entry->d_name, ".") == 0) || (strcmp(entry->d_name, "..") == 0)) continue;
+    is_directory = (entry->d_type == DT_DIR);
+    is_file = (entry->d_type == DT_REG);
+    // Only look up entries whose type the directory does not give:
+    if((entry->d_type == DT_UNKNOWN) || (entry->d_type == DT_LNK)){
+      if(fstatat(fd, entry->d_name, &info, AT_SYMLINK_NOFOLLOW) != 0) continue;
+      is_directory = S_ISDIR(info.st_mode);
+      is_file = S_ISREG(info.st_mode);
+      if(S_ISLNK(info.st_mode) && (fstatat(fd, entry->d_name, &info, 0) == 0)) is_file = S_ISREG(info.st_mode);
+    }
+    if((is_directory == 0) && (is_file == 0)) continue;
+    if(is_file == 1){
+      if((w->match == CEL_WALK_MATCH_NAME) && (is_CELwalk_name(entry->d_name) != 1)) continue;
+      if((w->match == CEL_WALK_MATCH_CONTENT) && (is_CELwalk_content(fd, entry->d_name) != 1)) continue;
+    }
+    if(entry_number == entry_size){
+      larger = (CELwalk_entry**)realloc(entries, (entry_size + CEL_WALK_ENTRY_STEP) * sizeof(CELwalk_entry*));
+      if(larger == NULL) break;
+      entries = larger;
+      entry_size += CEL_WALK_ENTRY_STEP;
+    }
+    path = join_CELwalk_path(directory->path, entry->d_name);
+    if(path == NULL) continue;
+    e = new_CELwalk_entry(path, is_directory, directory);
+    if(e == NULL) continue;
+    entries[entry_number++] = e;
+    if(is_directory == 0) file_number++;
+  }
+  if(d != NULL) closedir(d);
+  // Entries are listed in name order, so that the files are checked in the same order on every run:
+  if(entry_number > 1) qsort(entries, entry_number, sizeof(CELwalk_entry*), compare_CELwalk_entries);
+  for(i=1; i<entry_number; i++) entries[i - 1]->next = entries[i];
+  pthread_mutex_lock(&w->lock);
+  if(entry_number > 0) directory->children = entries[0];
+  directory->state = CEL_WALK_READ;
+  // Stack the subdirectories so that the first is read next:
+  for(i=entry_number; i>0; i--){
+    if(entries[i - 1]->is_directory == 0) continue;
+    entries[i - 1]->queued = w->directories;
+    w->directories = entries[i - 1];
+  }
+  w->file_number += file_number;
+  pthread_cond_broadcast(&w->changed);
+  pthread_mutex_unlock(&w->lock);
+  free(entries);
+}
+
+// Take the next directory to read, if any. Threads stop reading ahead once enough files are waiting,
+// except to read the directory that the cursor is waiting for:
+static CELwalk_entry *take_CELwalk_directory(CELwalk *w){
+  CELwalk_entry **link, *e = w->cursor;
+  if((e != NULL) && (e->is_directory == 1) && (e->state == CEL_WALK_UNREAD)){
+    for(link = &w->directories; *link != NULL; link = &(*link)->queued){
+      if(*link == e){
+        *link = e->queued;
+        break;
+      }
+    }
+    return e;
+  }
+  if((w->directories == NULL) || (w->file_number >= CEL_WALK_QUEUE_SIZE)) return NULL;
+  e = w->directories;
+  w->directories = e->queued;
+  return e;
+}
+
+static void *run_CELwalk_thread(void *arg){
+  CELwalk *w = (CELwalk*)arg;
+  CELwalk_entry *e;
+  pthread_mutex_lock(&w->lock);
+  while(w->stopping == 0){
+    e = take_CELwalk_directory(w);
+    if(e == NULL){
+      // Wait for a directory, until none are left and no other thread can find more:
+      if((w->directories == NULL) && (w->busy == 0)) break;
+      pthread_cond_wait(&w->changed, &w->lock);
+      continue;
+    }
+    e->state = CEL_WALK_READING;
+    w->busy++;
+    pthread_mutex_unlock(&w->lock);
+    read_CELwalk_directory(w, e);
+    pthread_mutex_lock(&w->lock);
+    w->busy--;
+    pthread_cond_broadcast(&w->changed);
+  }
+  pthread_cond_broadcast(&w->changed);
+  pthread_mutex_unlock(&w->lock);
+  return NULL;
+}
+
+CELwalk *create_CELwalk(char *root, int thread_number, char match){
+  CELwalk *w;
+  char *path;
+  int i;
+  if(thread_number < 1) thread_number = 1;
+  w = (CELwalk*)malloc(sizeof(CELwalk));
+  if(w == NULL) return NULL;
+  w->thread_number = 0;
+  w->cursor = NULL;
+  w->directories = NULL;
+  w->file_number = 0;
+  w->busy = 0;
+  w->match = match;
+  w->stopping = 0;
+  pthread_mutex_init(&w->lock, NULL);
+  pthread_cond_init(&w->changed, NULL);
+  w->threads = (pthread_t*)malloc(thread_number * sizeof(pthread_t));
+  path = (char*)malloc((strlen(root) + 1) * sizeof(char));
+  if((w->threads == NULL) || (path == NULL)){
+    free(path);
+    free_CELwalk(w);
+    return NULL;
+  }
+  strcpy(path, root);
+  w->cursor = new_CELwalk_entry(path, 1, NULL);
+  if(w->cursor == NULL){
+    free_CELwalk(w);
+    return NULL;
+  }
+  w->directories = w->cursor;
+  // Start the traversal threads:
+  for(i=0; i<thread_number; i++){
+    if(pthread_create(&w->threads[i], NULL, run_CELwalk_thread, w) != 0) break;
+    w->thread_number++;
+  }
+  if(w->thread_number == 0){
+    free_CELwalk(w);
+    return NULL;
+  }
+  return w;
+}
+
+// Move the cursor on from an entry that has been handed out (or has nothing left below it), freeing the
+// entries that it leaves behind:
+static CELwalk_entry *leave_CELwalk_entry(CELwalk_entry *e){
+  CELwalk_entry *next, *parent;
+  while(e != NULL){
+    next = e->next;
+    parent = e->parent;
+    free(e->path);
+    free(e);
+    if(next != NULL) return next;
+    e = parent;
+  }
+  return NULL;
+}
+
+char *next_CELwalk(CELwalk *w){
+  CELwalk_entry *e;
+  char *path = NULL;
+  pthread_mutex_lock(&w->lock);
+  while(((e = w->cursor) != NULL) && (w->stopping == 0)){
+    if(e->is_directory == 0){
+      path = e->path;
+      e->path = NULL;
+      w->cursor = leave_CELwalk_entry(e);
+      w->file_number--;
+      break;
+    }
+    // Wait for a directory to be read before going into it:
+    if(e->state != CEL_WALK_READ){
+      pthread_cond_broadcast(&w->changed);
+      pthread_cond_wait(&w->changed, &w->lock);
+      continue;
+    }
+    if(e->children != NULL) w->cursor = e->children;
+    else w->cursor = leave_CELwalk_entry(e);
+  }
+  pthread_cond_broadcast(&w->changed);
+  pthread_mutex_unlock(&w->lock);
+  return path;
+}
+
+void free_CELwalk(CELwalk *w){
+  CELwalk_entry *e, *parent;
+  int i;
+  if(w == NULL) return;
+  // Stop the traversal threads, even if files are still waiting to be checked:
+  pthread_mutex_lock(&w->lock);
+  w->stopping = 1;
+  pthread_cond_broadcast(&w->changed);
+  pthread_mutex_unlock(&w->lock);
+  for(i=0; i<w->thread_number; i++) pthread_join(w->threads[i], NULL);
+  if(w->threads != NULL) free(w->threads);
+  // Free what is left of the tree, working up from the cursor (entries before it are already freed):
+  for(e = w->cursor; e != NULL; e = parent){
+    parent = e->parent;
+    free_CELwalk_entries(e);
+    if(parent != NULL) parent->children = NULL;
+  }
+  pthread_cond_destroy(&w->changed);
+  pthread_mutex_destroy(&w->lock);
+  free(w);
+}
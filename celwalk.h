@@ -0,0 +1,67 @@
+// checkcel - check the validity of an Affymetrix CEL file.
+// Copyright (C) 2016 Alastair Droop, The Leeds MRC Medical Bioinformatics Centre <a.p.droop@leeds.ac.uk>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __checkcel_celwalk_h
+#define __checkcel_celwalk_h
+
+// Define the number of found files waiting to be checked before the traversal threads stop reading ahead:
+#define CEL_WALK_QUEUE_SIZE 4096
+
+// Define the number of bytes read from each file to recognise it by its content:
+#define CEL_WALK_SNIFF_SIZE 512
+
+// Define the ways of choosing which files found in a directory tree are checked:
+#define CEL_WALK_MATCH_NAME 0
+#define CEL_WALK_MATCH_CONTENT 1
+
+// Define the states of a directory in the traversal:
+#define CEL_WALK_UNREAD 0
+#define CEL_WALK_READING 1
+#define CEL_WALK_READ 2
+
+// Define the struct holding an entry of the tree being traversed. Each directory, once read, holds its
+// matching files and subdirectories sorted by name; unread directories are also stacked for the threads:
+typedef struct CELwalk_entry {
+  char *path;
+  char is_directory;
+  char state;
+  struct CELwalk_entry *parent;
+  struct CELwalk_entry *children;
+  struct CELwalk_entry *next;
+  struct CELwalk_entry *queued;
+} CELwalk_entry;
+
+// Define the struct holding a directory traversal. Directories are read in parallel (most recently found
+// first), while files are handed out in the order of a serial traversal from the cursor:
+typedef struct {
+  int thread_number;
+  pthread_t *threads;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  CELwalk_entry *cursor;
+  CELwalk_entry *directories;
+  size_t file_number;
+  int busy;
+  char match;
+  char stopping;
+} CELwalk;
+
+// Functions to find the CEL files (and archives) below a directory using several threads:
+CELwalk *create_CELwalk(char *root, int thread_number, char match);
+char *next_CELwalk(CELwalk *w);
+void free_CELwalk(CELwalk *w);
+
+#endif
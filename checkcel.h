@@ -0,0 +1,93 @@
+// checkcel - check the validity of an Affymetrix CEL file.
+// Copyright (C) 2016 Alastair Droop, The Leeds MRC Medical Bioinformatics Centre <a.p.droop@leeds.ac.uk>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __checkcel_h
+#define __checkcel_h
+
+// The public interface of libcheckcel. Each CELhandle belongs to one thread at a time, but any number of
+// handles can be used from different threads at once.
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Define the symbols exported from the shared library:
+#define CEL_EXPORT __attribute__((visibility("default")))
+
+// Define the status returned by the functions below:
+#define CEL_READ_VALUE_OK 0
+#define CEL_READ_VALUE_FAILED 1
+
+// Define the CEL file types:
+#define CEL_TYPE_UNKNOWN 100
+#define CEL_TYPE_BINARY 101
+#define CEL_TYPE_CALVIN 102
+#define CEL_TYPE_TEXT 103
+
+// Define the flags for open_CELhandle_path():
+#define CEL_OPEN_MEMORY_MAP 1
+
+// Define the flags for check_CELhandle() (these match the cache's option bits):
+#define CEL_CHECK_INTENSITY 1
+#define CEL_CHECK_STRUCTURAL 2
+#define CEL_CHECK_FINGERPRINT 4
+
+// Define the opaque handle for a single CEL file:
+typedef struct CELhandle CELhandle;
+
+// Define the struct holding the result of checking a file (the strings belong to the handle, and are
+// valid until the next check or until the handle is closed):
+typedef struct {
+  char valid;
+  char type;
+  const char *name;
+  const char *array;
+  const char *algorithm;
+  int32_t rows;
+  int32_t cols;
+  int32_t cell_margin;
+  uint32_t outliers;
+  uint32_t masked;
+  char intensity_stats_calculated;
+  float intensity_min;
+  float intensity_max;
+  int intensity_n_unique;
+  int intensity_n_invalid;
+  char intensity_hash_calculated;
+  uint64_t intensity_hash;
+} CELsummary;
+
+// Define the function shown each block of intensities in file order (the block is only valid during the call):
+typedef void (*CELhandle_visit)(const float *data, size_t n, void *arg);
+
+// Functions to open a file by path, from a descriptor or from a buffer (which is read in place, so must
+// outlive the handle). The descriptor is duplicated, so remains the caller's to close, but shares its offset
+// with the copy. The name is used in the summary. Each returns NULL on failure:
+CEL_EXPORT CELhandle *open_CELhandle_path(const char *path, int flags);
+CEL_EXPORT CELhandle *open_CELhandle_fd(int fd, const char *name);
+CEL_EXPORT CELhandle *open_CELhandle_buffer(const void *data, size_t size, const char *name);
+CEL_EXPORT void close_CELhandle(CELhandle *h);
+
+// Set the number of threads used to parse the intensities of large text files:
+CEL_EXPORT void set_CELhandle_threads(CELhandle *h, int threads);
+
+// Check the file, filling in the summary (which may be NULL). Returns CEL_READ_VALUE_OK for valid files:
+CEL_EXPORT char check_CELhandle(CELhandle *h, int flags, CELsummary *s);
+
+// Check the file while reading its intensities, showing each block to the visitor. Blocks are shown as
+// they are read, so a file found to be invalid later may already have shown some:
+CEL_EXPORT char visit_CELhandle(CELhandle *h, int flags, CELhandle_visit visit, void *arg, CELsummary *s);
+
+#endif
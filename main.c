@@ -18,10 +18,103 @@
 #include <getopt.h>
 #include <glob.h>
 #include <string.h>
+#include <sys/stat.h>
 #include "cel.h"
 
+// Define the values returned by getopt_long() for options with no short form:
+#define CEL_OPTION_CACHE 256
+#define CEL_OPTION_FINGERPRINT 257
+#define CEL_OPTION_DUPLICATES 258
+#define CEL_OPTION_SERVE 259
+#define CEL_OPTION_FILES_FROM 260
+#define CEL_OPTION_SNIFF 261
+#define CEL_OPTION_COLUMNAR 262
+#define CEL_OPTION_PROFILE 263
+#define CEL_OPTION_PREFETCH 264
+#define CEL_OPTION_URING 265
+
+#ifdef CEL_WRAP_ALLOCATIONS
+// Count the program's allocations for --profile. The Makefile has the linker send its calls to malloc(),
+// calloc() and realloc() here, and each is passed on to whichever allocator the program was linked with:
+void *__real_malloc(size_t n);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *data, size_t n);
+
+void *__wrap_malloc(size_t n){
+  count_CELprofile_allocation();
+  return __real_malloc(n);
+}
+
+void *__wrap_calloc(size_t n, size_t size){
+  count_CELprofile_allocation();
+  return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *data, size_t n){
+  count_CELprofile_allocation();
+  return __real_realloc(data, n);
+}
+#endif
+
 void print_usage(){
-  printf("usage: checkcel [-cfvh] file [...]\n");
+  printf("usage: checkcel [-0cfmrsvh] [-j jobs] [-t threads] [--files-from list] [--columnar output] [--prefetch depth] [--uring depth] [--profile] file [...]\n");
+  printf("       checkcel [-cfmsvh] [-j jobs] [-t threads] [--prefetch depth] [--uring depth] [--profile] --serve socket\n");
+}
+
+// Check a file, or (if walk_threads is positive) the matching files below a directory as they are found:
+char submit_CELpath(CELbatch *b, char *path, int walk_threads, char match){
+  CELwalk *w;
+  struct stat info;
+  char *found;
+  char status = 0;
+  if((walk_threads < 1) || (stat(path, &info) != 0) || (!S_ISDIR(info.st_mode))) return submit_CELbatch(b, path);
+  w = create_CELwalk(path, walk_threads, match);
+  if(w == NULL) return 1;
+  while((found = next_CELwalk(w)) != NULL){
+    if(status == 0) status = submit_CELbatch(b, found);
+    free(found);
+  }
+  free_CELwalk(w);
+  return status;
+}
+
+// Check each path in a list (read as it arrives, so the first files are checked before the list ends):
+char submit_CELpaths(CELbatch *b, FILE *list, char separator, int walk_threads, char match){
+  char *path = NULL;
+  size_t size = 0;
+  ssize_t length;
+  char status = 0;
+  while((length = getdelim(&path, &size, separator, list)) >= 0){
+    if((length > 0) && (path[length - 1] == separator)) path[--length] = '\0';
+    if(length == 0) continue;
+    if(submit_CELpath(b, path, walk_threads, match) != 0){
+      status = 1;
+      break;
+    }
+  }
+  free(path);
+  return status;
+}
+
+// Check the paths listed in the given file ("-" for the standard input):
+char submit_CELpath_list(CELbatch *b, char *list_path, char separator, int walk_threads, char match){
+  FILE *list;
+  char status;
+  if(strcmp(list_path, "-") == 0) return submit_CELpaths(b, stdin, separator, walk_threads, match);
+  list = fopen(list_path, "r");
+  if(list == NULL) return 1;
+  status = submit_CELpaths(b, list, separator, walk_threads, match);
+  fclose(list);
+  return status;
+}
+
+// Release the cache and output collectors held by the options:
+void free_CELoptions(CELcheck_options *o, FILE *columnar_stream){
+  close_CELcache(o->cache);
+  free_CELfingerprints(o->duplicates);
+  free_CELcolumns(o->columns);
+  free_CELprofiles(o->profiles);
+  if((columnar_stream != NULL) && (columnar_stream != stdout)) fclose(columnar_stream);
 }
 
 void print_version(){
@@ -30,22 +123,129 @@ void print_version(){
 
 int main (int argc, const char * argv[])
 {
-  int i, j, option;
-  char check_spot_level_data, filter_bad_files;
+  int i, j, option, job_number;
+  char *cache_path = NULL;
+  char *serve_path = NULL;
+  char *list_path = NULL;
+  char *columnar_path = NULL;
+  FILE *columnar_stream = NULL;
+  FILE *messages = stdout;
+  char separator = '\n';
+  char recursive = 0;
+  char match = CEL_WALK_MATCH_NAME;
+  int walk_threads = 0;
+  char failed = 0;
+  char duplicates = 0;
   glob_t glob_data;
-  CELfile f;
-  CELdata cel_data;
+  CELcheck_options options;
+  CELpool *pool;
+  CELbatch *batch;
+  static struct option long_options[] = {
+    {"structural", no_argument, NULL, 's'},
+    {"cache", required_argument, NULL, CEL_OPTION_CACHE},
+    {"fingerprint", no_argument, NULL, CEL_OPTION_FINGERPRINT},
+    {"duplicates", no_argument, NULL, CEL_OPTION_DUPLICATES},
+    {"serve", required_argument, NULL, CEL_OPTION_SERVE},
+    {"files-from", required_argument, NULL, CEL_OPTION_FILES_FROM},
+    {"sniff", no_argument, NULL, CEL_OPTION_SNIFF},
+    {"columnar", required_argument, NULL, CEL_OPTION_COLUMNAR},
+    {"profile", no_argument, NULL, CEL_OPTION_PROFILE},
+    {"prefetch", required_argument, NULL, CEL_OPTION_PREFETCH},
+    {"uring", required_argument, NULL, CEL_OPTION_URING},
+    {"help", no_argument, NULL, 'h'},
+    {"version", no_argument, NULL, 'v'},
+    {NULL, 0, NULL, 0}
+  };
 
   // Sort out the command line options:
-  check_spot_level_data = 0;
-  filter_bad_files = 0;
-  while ((option = getopt(argc, (char* const*)argv, "cfvh")) != -1){
+  options.read_intensity = 0;
+  options.filter_bad_files = 0;
+  options.memory_map = 0;
+  options.structural = 0;
+  options.fingerprint = 0;
+  options.cache = NULL;
+  options.duplicates = NULL;
+  options.columns = NULL;
+  options.profile = 0;
+  options.profiles = NULL;
+  options.prefetch = 0;
+  options.uring = 0;
+  options.text_threads = 1;
+  job_number = 1;
+  while ((option = getopt_long(argc, (char* const*)argv, "0cfj:mrst:vh", long_options, NULL)) != -1){
     switch (option){
+      case '0':
+        separator = '\0';
+        break;
       case 'c':
-        check_spot_level_data = 1;
+        options.read_intensity = 1;
         break;
       case 'f':
-        filter_bad_files = 1;
+        options.filter_bad_files = 1;
+        break;
+      case 'j':
+        job_number = atoi(optarg);
+        if(job_number < 1){
+          print_usage();
+          return 1;
+        }
+        break;
+      case 'm':
+        options.memory_map = 1;
+        break;
+      case CEL_OPTION_CACHE:
+        cache_path = optarg;
+        break;
+      case CEL_OPTION_FINGERPRINT:
+        options.read_intensity = 1;
+        options.fingerprint = 1;
+        break;
+      case CEL_OPTION_DUPLICATES:
+        options.read_intensity = 1;
+        options.fingerprint = 1;
+        duplicates = 1;
+        break;
+      case 'r':
+        recursive = 1;
+        break;
+      case CEL_OPTION_SNIFF:
+        match = CEL_WALK_MATCH_CONTENT;
+        break;
+      case CEL_OPTION_COLUMNAR:
+        columnar_path = optarg;
+        break;
+      case CEL_OPTION_PROFILE:
+        options.profile = 1;
+        break;
+      case CEL_OPTION_PREFETCH:
+        options.prefetch = atoi(optarg);
+        if(options.prefetch < 1){
+          print_usage();
+          return 1;
+        }
+        break;
+      case CEL_OPTION_URING:
+        options.uring = atoi(optarg);
+        if(options.uring < 1){
+          print_usage();
+          return 1;
+        }
+        break;
+      case CEL_OPTION_FILES_FROM:
+        list_path = optarg;
+        break;
+      case CEL_OPTION_SERVE:
+        serve_path = optarg;
+        break;
+      case 's':
+        options.structural = 1;
+        break;
+      case 't':
+        options.text_threads = atoi(optarg);
+        if(options.text_threads < 1){
+          print_usage();
+          return 1;
+        }
         break;
       case 'v':
         print_version();
@@ -53,8 +253,24 @@ int main (int argc, const char * argv[])
       case 'h':
         print_usage();
         printf("Options:\n");
+        printf("-0: paths in lists are separated by NUL characters rather than newlines\n");
         printf("-c: calculate and display intensity statistics\n");
         printf("-f: filter out invalid CEL files\n");
+        printf("-j: check the given number of files in parallel\n");
+        printf("-m: read files through a memory map\n");
+        printf("--fingerprint: add a fingerprint of the intensity values (implies -c)\n");
+        printf("--duplicates: list the groups of files with identical intensity values, instead of checking each file\n");
+        printf("--files-from LIST: also check the paths listed in the given file (or the standard input if LIST is -)\n");
+        printf("--columnar FILE: write the results to the given file (or the standard output if FILE is -) in the columnar binary format\n");
+        printf("--serve SOCKET: check the batches of paths sent to the given Unix domain socket until stopped\n");
+        printf("--prefetch DEPTH: start reading the given number of files ahead of those being checked, and drop checked files from the page cache\n");
+        printf("--uring DEPTH: open and read the start of up to the given number of files at once through io_uring (if available)\n");
+        printf("--profile: add the time spent in each phase and the I/O made to each line, and summarise each format on the standard error\n");
+        printf("--cache FILE: reuse the results of unchanged files from (and add new results to) the given cache file\n");
+        printf("-r: check the CEL files and archives found below any directories given (using -j threads to search)\n");
+        printf("--sniff: with -r, choose files by their first bytes rather than their names\n");
+        printf("-s, --structural: check that the declared data sections fit in the file without reading them\n");
+        printf("-t: parse the intensities of large text files with the given number of threads\n");
         printf("-h: display this help information\n");
         printf("-v: display version\n");
         printf("\nOutput columns:\n");
@@ -72,6 +288,12 @@ int main (int argc, const char * argv[])
         printf("  : maximum intensity value\n");
         printf("  : unique value count\n");
         printf("  : invalid value count\n");
+        printf("\nProfile (--profile):\n");
+        printf("  : open, sniff, header, payload and statistics time (ms)\n");
+        printf("  : bytes read\n");
+        printf("  : read calls\n");
+        printf("  : seek calls\n");
+        printf("  : allocations\n");
         return 0;
       default:
         print_usage();
@@ -79,27 +301,133 @@ int main (int argc, const char * argv[])
     }
   }
 
+  // The duplicate summary and columnar output cover a single run, so cannot be served (or combined):
+  if(((serve_path != NULL) && ((duplicates == 1) || (columnar_path != NULL))) || ((duplicates == 1) && (columnar_path != NULL))){
+    print_usage();
+    return 1;
+  }
+
+  // Open the result cache if one was given:
+  if(cache_path != NULL){
+    options.cache = open_CELcache(cache_path);
+    if(options.cache == NULL){
+      fprintf(stderr, "could not open cache file %s\n", cache_path);
+      return 1;
+    }
+  }
+
+  // Check the files sent by clients until the server is stopped:
+  if(serve_path != NULL){
+    i = serve_CELsocket(serve_path, job_number, &options);
+    if(i != 0) fprintf(stderr, "could not serve on socket %s\n", serve_path);
+    close_CELcache(options.cache);
+    return i;
+  }
+
+  // Collect the profile of each file for the summary (served files are only profiled line by line):
+  if(options.profile == 1){
+    options.profiles = create_CELprofiles();
+    if(options.profiles == NULL){
+      free_CELoptions(&options, columnar_stream);
+      return 1;
+    }
+  }
+
+  // Collect fingerprints instead of printing results if only duplicates are wanted:
+  if(duplicates == 1){
+    options.duplicates = create_CELfingerprints();
+    if(options.duplicates == NULL){
+      free_CELoptions(&options, columnar_stream);
+      return 1;
+    }
+  }
+
+  // Collect the results into batches of columns if columnar output is wanted:
+  if(columnar_path != NULL){
+    if(strcmp(columnar_path, "-") == 0) columnar_stream = stdout;
+    else columnar_stream = fopen(columnar_path, "wb");
+    if(columnar_stream != NULL) options.columns = create_CELcolumns(columnar_stream);
+    if(options.columns == NULL){
+      free_CELoptions(&options, columnar_stream);
+      fprintf(stderr, "could not write columnar output to %s\n", columnar_path);
+      return 1;
+    }
+    // Messages must not be mixed into columnar output written to the standard output:
+    if(columnar_stream == stdout) messages = stderr;
+  }
+
+  // Start the worker threads (a single job is checked inline):
+  if(job_number > 1) pool = create_CELpool(job_number, &options);
+  else pool = create_CELpool(0, &options);
+  if(pool == NULL){
+    free_CELoptions(&options, columnar_stream);
+    return 1;
+  }
+  batch = create_CELbatch(pool, stdout);
+  if(batch == NULL){
+    free_CELpool(pool);
+    free_CELoptions(&options, columnar_stream);
+    return 1;
+  }
+
+  // Directories are searched with as many threads as files are checked with:
+  if(recursive == 1) walk_threads = job_number;
+
+  // Check the paths in the file list first:
+  if((list_path != NULL) && (submit_CELpath_list(batch, list_path, separator, walk_threads, match) != 0)){
+    free_CELbatch(batch);
+    free_CELpool(pool);
+    free_CELoptions(&options, columnar_stream);
+    fprintf(stderr, "could not read file list %s\n", list_path);
+    return 1;
+  }
+
   // Loop over the remaining command line arguments:
   for(i=optind; i<argc; i++){
+    //  A lone "-" reads a list of paths from the standard input:
+    if(strcmp(argv[i], "-") == 0){
+      if(submit_CELpath_list(batch, "-", separator, walk_threads, match) != 0){
+        free_CELbatch(batch);
+        free_CELpool(pool);
+        free_CELoptions(&options, columnar_stream);
+        fprintf(stderr, "could not read file list from the standard input\n");
+        return 1;
+      }
+      continue;
+    }
     //  Expand the wildcard file listing to get a list of valid files to process:
     glob(argv[i], 0, NULL, &glob_data);
-    if(glob_data.gl_matchc < 1){
-      printf("no matching file\n");
+    if(glob_data.gl_pathc < 1){
+      globfree(&glob_data);
+      free_CELbatch(batch);
+      free_CELpool(pool);
+      // Columnar output still ends with its footer, so the files already checked can be read:
+      if(options.columns != NULL) finish_CELcolumns(options.columns);
+      free_CELoptions(&options, columnar_stream);
+      fprintf(messages, "no matching file\n");
       return 1;
     }
-    // Initialise the CEL file dataset:
-    init_CELdata(&cel_data);
-    //  Run through each file in turn, processing it:
-    for(j=0; j<glob_data.gl_matchc; j++){
-      f = open_CELfile(glob_data.gl_pathv[j]);
-      readCEL(f, &cel_data, check_spot_level_data, 0);
-      if(cel_data.valid == 1){
-        printf("%s\t", f.name);
-        print_CELdata(&cel_data);
-      } else if(filter_bad_files != 1) printf("%s\tunknown\n", f.name);
-      free_CELdata(&cel_data);
-      close_CELfile(f);
+    //  Run through each file in turn, processing it (output is written in order):
+    for(j=0; j<glob_data.gl_pathc; j++){
+      if(submit_CELpath(batch, glob_data.gl_pathv[j], walk_threads, match) != 0){
+        // Write out the files ahead of it first, so the message follows their results:
+        flush_CELbatch(batch);
+        fprintf(messages, "could not check %s\n", glob_data.gl_pathv[j]);
+        failed = 1;
+      }
     }
+    globfree(&glob_data);
+  }
+  free_CELbatch(batch);
+  free_CELpool(pool);
+  if(options.duplicates != NULL) print_CELfingerprints(stdout, options.duplicates);
+  if(options.profiles != NULL) print_CELprofiles(stderr, options.profiles);
+  // Write the last batch of columns, and the footer that indexes them:
+  i = failed;
+  if((options.columns != NULL) && (finish_CELcolumns(options.columns) != CEL_READ_VALUE_OK)){
+    fprintf(stderr, "could not write columnar output to %s\n", columnar_path);
+    i = 1;
   }
-  return 0;
+  free_CELoptions(&options, columnar_stream);
+  return i;
 }